@@ -0,0 +1,6 @@
+uniform sampler2D gradient;
+varying float level;
+
+void main(void) {
+	gl_FragColor = texture2D(gradient, vec2(level, 0.5));
+}
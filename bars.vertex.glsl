@@ -0,0 +1,13 @@
+attribute vec2 corner;  // of the unit quad
+attribute vec3 bar;     // left and right edge on screen, u of the bin in the state texture
+attribute float height; // raw magnitude
+uniform float scale;    // full-scale magnitude, inverted
+uniform sampler2D state;
+uniform float smoothed; // 1 takes the heights from the smoothing state instead
+varying float level;
+
+void main(void) {
+	float h = mix(height * scale, texture2DLod(state, vec2(bar.z, 0.5), 0.0).r, smoothed);
+	level = corner.y * h;
+	gl_Position = vec4(mix(bar.x, bar.y, corner.x), level, 0, 1);
+}
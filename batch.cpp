@@ -0,0 +1,440 @@
+#include "batch.h"
+#include "beat.h"
+#include "converter.h"
+#include "fft.h"
+#include "global.h"
+#include "spectrum_store.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Long files are split into tasks of this many frames so idle workers can
+// steal part of a file instead of waiting for the last big one to finish.
+static const size_t FRAMES_PER_TASK = 512;
+
+struct ExtractJob {
+  std::string input;
+  std::string output;
+  long rate = 0;
+  std::vector<double> samples;
+  size_t hop = 0;
+  size_t frames = 0;
+  size_t bins = 0;
+  std::vector<float> magnitudes;
+  std::atomic<size_t> tasks_left{0};
+};
+
+static bool write_npy_files = false;
+static StoreOptions store_options;
+// 0 means one analysis frame per 1/TARGET_FPS s, like the live view.
+static size_t fft_size = 0;
+static size_t fft_threads = 1;
+
+static std::mutex print_lock;
+static std::atomic<int> failures{0};
+
+static void report_failure(const std::string &file, const char *what) {
+  std::lock_guard<std::mutex> guard(print_lock);
+  std::cerr << "extract: " << file << ": " << what << std::endl;
+  failures++;
+}
+
+static void write_npy(const std::string &path, const float *data,
+                      size_t rows, size_t cols) {
+  std::stringstream header;
+  header << "{'descr': '<f4', 'fortran_order': False, 'shape': (" << rows
+         << ", " << cols << "), }";
+  std::string dict = header.str();
+  // Magic (6) + version (2) + header length (2) + dict + '\n' must be a
+  // multiple of 64 bytes.
+  size_t unpadded = 10 + dict.size() + 1;
+  dict.append((64 - unpadded % 64) % 64, ' ');
+  dict.push_back('\n');
+
+  std::ofstream ofs(path, std::ios::binary);
+  if (ofs.fail()) {
+    std::stringstream ss;
+    ss << "couldn't open " << path << " for writing";
+    throw std::runtime_error(ss.str());
+  }
+  uint16_t dict_size = dict.size();
+  ofs.write("\x93NUMPY\x01\x00", 8);
+  ofs.put(dict_size & 0xff);
+  ofs.put(dict_size >> 8);
+  ofs.write(dict.data(), dict.size());
+  ofs.write(reinterpret_cast<const char *>(data), sizeof(float) * rows * cols);
+  if (ofs.fail()) {
+    std::stringstream ss;
+    ss << "write to " << path << " failed";
+    throw std::runtime_error(ss.str());
+  }
+}
+
+static void finish_job(std::shared_ptr<ExtractJob> job) {
+  try {
+    if (write_npy_files) {
+      write_npy(job->output, job->magnitudes.data(), job->frames, job->bins);
+    } else {
+      write_spectrum_store(job->output, job->magnitudes.data(), job->frames,
+                           job->bins, TARGET_FPS, job->rate,
+                           store_options);
+    }
+    std::lock_guard<std::mutex> guard(print_lock);
+    std::cout << job->input << " -> " << job->output << " (" << job->frames
+              << " x " << job->bins << ")" << std::endl;
+  } catch (std::exception &e) {
+    report_failure(job->input, e.what());
+  }
+  job->magnitudes = std::vector<float>();
+}
+
+static void analyze_frames(std::shared_ptr<ExtractJob> job, size_t first,
+                           size_t last) {
+  size_t n = 2 * job->bins;
+  std::vector<double> windows(n * FFT_BATCH);
+  std::vector<double> amplitudes(job->bins * FFT_BATCH);
+
+  for (size_t batch_first = first; batch_first < last;
+       batch_first += FFT_BATCH) {
+    size_t count = std::min(FFT_BATCH, last - batch_first);
+    // Windows overlap when fft_size > hop, so they are copied out to give
+    // FFTW the contiguous batch layout its plans expect.
+    for (size_t k = 0; k < count; k++) {
+      const double *window =
+          job->samples.data() + (batch_first + k) * job->hop;
+      std::copy(window, window + n, windows.begin() + k * n);
+    }
+    amplitudes_of_frames(windows.data(), n, count, amplitudes.data(),
+                         fft_threads);
+    std::copy(amplitudes.begin(), amplitudes.begin() + count * job->bins,
+              job->magnitudes.begin() + batch_first * job->bins);
+  }
+
+  if (--job->tasks_left == 0) {
+    job->samples = std::vector<double>();
+    finish_job(job);
+  }
+}
+
+static void decode_file(ThreadPool &pool, std::shared_ptr<ExtractJob> job) {
+  try {
+    PCM_data pcm = from_mp3(job->input.c_str());
+    job->rate = pcm.rate;
+    size_t sample_frame_bytes = pcm.channels * sample_byte_size(pcm.format);
+    size_t whole_bytes =
+        pcm.bytes.size() - pcm.bytes.size() % sample_frame_bytes;
+    job->samples =
+        mono_samples(pcm.bytes.data(), whole_bytes, pcm.format, pcm.channels);
+    // Same framing as start_audio() uses for the live view.
+    job->hop = pcm.rate / TARGET_FPS;
+    job->hop -= job->hop % pcm.channels;
+  } catch (std::exception &e) {
+    report_failure(job->input, e.what());
+    return;
+  }
+
+  size_t n = fft_size != 0 ? fft_size : job->hop;
+  job->bins = n / 2;
+  n = 2 * job->bins;
+  job->frames =
+      job->samples.size() >= n ? (job->samples.size() - n) / job->hop + 1 : 0;
+  job->magnitudes.assign(job->frames * job->bins, 0);
+
+  size_t tasks = (job->frames + FRAMES_PER_TASK - 1) / FRAMES_PER_TASK;
+  if (tasks == 0) {
+    finish_job(job);
+    return;
+  }
+  job->tasks_left = tasks;
+  for (size_t first = 0; first < job->frames; first += FRAMES_PER_TASK) {
+    size_t last = std::min(job->frames, first + FRAMES_PER_TASK);
+    pool.submit([job, first, last] { analyze_frames(job, first, last); });
+  }
+}
+
+// A whole number of at least `min`, nothing else in `text`.
+static bool parse_count(const char *text, long min, size_t &out) {
+  char *end;
+  errno = 0;
+  long value = strtol(text, &end, 10);
+  if (end == text || *end != '\0' || errno != 0 || value < min) {
+    return false;
+  }
+  out = value;
+  return true;
+}
+
+static void usage() {
+  std::cerr << "usage: audio-visualizer extract [-j N] [-n FFT_SIZE] "
+               "[-t FFT_THREADS] [-b 8|16] [-c raw|zstd|lz4] [--npy] "
+               "OUT_DIR FILE..."
+            << std::endl;
+}
+
+static bool parse_compression(const char *name, uint32_t &compression) {
+  if (strcmp(name, "raw") == 0) {
+    compression = STORE_RAW;
+  } else if (strcmp(name, "zstd") == 0) {
+    compression = STORE_ZSTD;
+  } else if (strcmp(name, "lz4") == 0) {
+    compression = STORE_LZ4;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+int batch_extract(int argc, char **argv) {
+  size_t num_workers = std::thread::hardware_concurrency();
+  int arg = 0;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (strcmp(argv[arg], "--npy") == 0) {
+      write_npy_files = true;
+    } else if (arg + 1 < argc && strcmp(argv[arg], "-j") == 0) {
+      if (!parse_count(argv[++arg], 1, num_workers)) {
+        usage();
+        return 2;
+      }
+    } else if (arg + 1 < argc && strcmp(argv[arg], "-n") == 0) {
+      if (!parse_count(argv[++arg], 2, fft_size)) {
+        usage();
+        return 2;
+      }
+    } else if (arg + 1 < argc && strcmp(argv[arg], "-t") == 0) {
+      if (!parse_count(argv[++arg], 1, fft_threads)) {
+        usage();
+        return 2;
+      }
+    } else if (arg + 1 < argc && strcmp(argv[arg], "-b") == 0) {
+      size_t bits;
+      if (!parse_count(argv[++arg], 8, bits) || (bits != 8 && bits != 16)) {
+        usage();
+        return 2;
+      }
+      store_options.sample_bits = bits;
+    } else if (arg + 1 < argc && strcmp(argv[arg], "-c") == 0) {
+      if (!parse_compression(argv[++arg], store_options.compression)) {
+        usage();
+        return 2;
+      }
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (argc - arg < 2) {
+    usage();
+    return 2;
+  }
+  if (!write_npy_files &&
+      !store_compression_supported(store_options.compression)) {
+    std::cerr << "extract: this build has no support for the requested "
+                 "compression"
+              << std::endl;
+    return 2;
+  }
+
+  std::filesystem::path out_dir(argv[arg++]);
+  std::error_code ec;
+  std::filesystem::create_directories(out_dir, ec);
+  if (ec) {
+    std::cerr << "extract: " << out_dir << ": " << ec.message() << std::endl;
+    return 1;
+  }
+
+  // Outputs are named after the inputs' stems: two inputs with the same
+  // stem (a/song.mp3, b/song.mp3) would be written into one file at once.
+  const char *extension = write_npy_files ? ".npy" : ".avs";
+  std::vector<std::shared_ptr<ExtractJob>> jobs;
+  std::map<std::string, std::string> input_of;
+  for (; arg < argc; arg++) {
+    auto job = std::make_shared<ExtractJob>();
+    job->input = argv[arg];
+    job->output =
+        (out_dir / std::filesystem::path(job->input).stem()).string() +
+        extension;
+    auto [other, added] = input_of.emplace(job->output, job->input);
+    if (!added) {
+      std::cerr << "extract: " << other->second << " and " << job->input
+                << " would both be written to " << job->output << std::endl;
+      return 2;
+    }
+    jobs.push_back(job);
+  }
+
+  ThreadPool pool(num_workers);
+  for (auto &job : jobs) {
+    pool.submit([&pool, job] { decode_file(pool, job); });
+  }
+  pool.wait_idle();
+
+  return failures == 0 ? 0 : 1;
+}
+
+static const double TEMPO_TOLERANCE = 0.04;
+
+struct BeatTotals {
+  size_t files = 0;
+  size_t referenced = 0;
+  size_t correct = 0;
+  size_t octave_errors = 0;
+  size_t frames = 0;
+  double seconds_tracking = 0;
+};
+
+static BeatTotals beat_totals;
+
+static bool same_tempo(double bpm, double reference) {
+  return std::abs(bpm / reference - 1) < TEMPO_TOLERANCE;
+}
+
+static void track_file(const std::string &input, double reference) {
+  std::vector<double> samples;
+  size_t hop;
+  try {
+    PCM_data pcm = from_mp3(input.c_str());
+    size_t sample_frame_bytes = pcm.channels * sample_byte_size(pcm.format);
+    size_t whole_bytes =
+        pcm.bytes.size() - pcm.bytes.size() % sample_frame_bytes;
+    samples =
+        mono_samples(pcm.bytes.data(), whole_bytes, pcm.format, pcm.channels);
+    hop = pcm.rate / TARGET_FPS;
+    hop -= hop % pcm.channels;
+  } catch (std::exception &e) {
+    report_failure(input, e.what());
+    return;
+  }
+
+  size_t bins = hop / 2;
+  size_t n = 2 * bins;
+  size_t frames = samples.size() >= n ? (samples.size() - n) / hop + 1 : 0;
+  std::vector<double> windows(n * FFT_BATCH);
+  std::vector<double> spectra(bins * FFT_BATCH);
+  std::vector<double> estimates(frames);
+
+  BeatTracker tracker(TARGET_FPS);
+  size_t onsets = 0;
+  std::chrono::steady_clock::duration tracking{0};
+  for (size_t first = 0; first < frames; first += FFT_BATCH) {
+    size_t count = std::min(FFT_BATCH, frames - first);
+    for (size_t k = 0; k < count; k++) {
+      const double *window = samples.data() + (first + k) * hop;
+      std::copy(window, window + n, windows.begin() + k * n);
+    }
+    amplitudes_of_frames(windows.data(), n, count, spectra.data());
+
+    // Only the tracker is timed, the FFTs are what the live view does anyway.
+    for (size_t k = 0; k < count; k++) {
+      auto start = std::chrono::steady_clock::now();
+      const BeatState &state = tracker.process(spectra.data() + k * bins, bins);
+      tracking += std::chrono::steady_clock::now() - start;
+      onsets += state.onset;
+      estimates[first + k] = state.bpm;
+    }
+  }
+
+  const BeatState &state = tracker.state();
+  size_t agreeing = 0;
+  for (double bpm : estimates) {
+    agreeing += bpm > 0 && same_tempo(bpm, state.bpm);
+  }
+  double seconds = (double)frames / TARGET_FPS;
+  double tracking_seconds = std::chrono::duration<double>(tracking).count();
+
+  std::stringstream line;
+  line.setf(std::ios::fixed);
+  line.precision(1);
+  line << input << ": " << state.bpm << " BPM, confidence "
+       << std::setprecision(2) << state.confidence << std::setprecision(1)
+       << ", agrees " << (frames ? 100.0 * agreeing / frames : 0)
+       << "% of the time, " << (seconds > 0 ? onsets / seconds : 0)
+       << " onsets/s, " << std::setprecision(2)
+       << (frames ? 1e6 * tracking_seconds / frames : 0) << " us/frame";
+
+  std::lock_guard<std::mutex> guard(print_lock);
+  beat_totals.files++;
+  beat_totals.frames += frames;
+  beat_totals.seconds_tracking += tracking_seconds;
+  if (reference > 0) {
+    bool correct = same_tempo(state.bpm, reference);
+    bool octave = false;
+    for (double factor : {1.0 / 3, 0.5, 2.0, 3.0}) {
+      octave |= same_tempo(state.bpm, factor * reference);
+    }
+    beat_totals.referenced++;
+    beat_totals.correct += correct;
+    beat_totals.octave_errors += octave;
+    line << std::setprecision(1) << ", reference " << reference << " "
+         << (correct ? "ok" : octave ? "octave error" : "wrong");
+  }
+  std::cout << line.str() << std::endl;
+}
+
+static void beats_usage() {
+  std::cerr << "usage: audio-visualizer beats [-j N] [--bpm BPM] FILE... "
+               "[--bpm BPM] FILE..."
+            << std::endl;
+}
+
+int batch_beats(int argc, char **argv) {
+  size_t num_workers = std::thread::hardware_concurrency();
+  double reference = 0;
+  std::vector<std::pair<std::string, double>> files;
+  for (int arg = 0; arg < argc; arg++) {
+    if (arg + 1 < argc && strcmp(argv[arg], "-j") == 0) {
+      if (!parse_count(argv[++arg], 1, num_workers)) {
+        beats_usage();
+        return 2;
+      }
+    } else if (arg + 1 < argc && strcmp(argv[arg], "--bpm") == 0) {
+      reference = atof(argv[++arg]);
+    } else if (argv[arg][0] == '-') {
+      beats_usage();
+      return 2;
+    } else {
+      files.emplace_back(argv[arg], reference);
+    }
+  }
+  if (files.empty()) {
+    beats_usage();
+    return 2;
+  }
+
+  ThreadPool pool(num_workers);
+  for (auto &file : files) {
+    pool.submit([file] { track_file(file.first, file.second); });
+  }
+  pool.wait_idle();
+
+  std::cout.setf(std::ios::fixed);
+  std::cout.precision(2);
+  if (beat_totals.frames != 0) {
+    std::cout << beat_totals.files << " files, "
+              << beat_totals.frames / (60.0 * TARGET_FPS) << " min, "
+              << 1e6 * beat_totals.seconds_tracking / beat_totals.frames
+              << " us/frame" << std::endl;
+  }
+  if (beat_totals.referenced != 0) {
+    std::cout << "tempo correct: " << beat_totals.correct << "/"
+              << beat_totals.referenced << ", with octave errors: "
+              << beat_totals.correct + beat_totals.octave_errors << "/"
+              << beat_totals.referenced << std::endl;
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,23 @@
+#ifndef _AUDIO_VISUALIZER_BATCH_H_
+#define _AUDIO_VISUALIZER_BATCH_H_
+
+// `audio-visualizer extract [-j N] [-n FFT_SIZE] [-t FFT_THREADS] [-b 8|16]
+//                           [-c raw|zstd|lz4] [--npy] OUT_DIR FILE...`
+// Writes the STFT magnitudes of every FILE (one frame per 1/TARGET_FPS s, the
+// same frames the live view shows) to OUT_DIR/<name>.avs (see
+// spectrum_store.h), or to OUT_DIR/<name>.npy as float32 [frames x bins] with
+// --npy. -n sets a longer analysis window at the same hop, -t lets transforms
+// of LARGE_FFT_SIZE and up run on several threads. Returns the process exit
+// code.
+int batch_extract(int argc, char **argv);
+
+// `audio-visualizer beats [-j N] [--bpm BPM] FILE... [--bpm BPM] FILE...`
+// Runs the live onset and beat tracker (beat.h) over whole files, framed like
+// the live view, and prints for each the final tempo, how much of the time
+// the estimate agreed with it, the onset rate and the tracker's cost per
+// frame. --bpm sets the reference tempo of the files after it; the estimate
+// is then scored as correct within 4%, or as an octave error when it is
+// within 4% of 1/3, 1/2, 2 or 3 times the reference.
+int batch_beats(int argc, char **argv);
+
+#endif
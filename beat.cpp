@@ -0,0 +1,240 @@
+#include "beat.h"
+#include <algorithm>
+#include <cmath>
+
+// Flux is taken on log(1 + COMPRESSION * magnitude / level), so it doesn't
+// depend on the sample format or the playback volume.
+static const double COMPRESSION = 1000;
+static const double LEVEL_DECAY = 0.999;
+
+// An onset is a local maximum of the flux above mean + THRESHOLD_K * deviation
+// of the last THRESHOLD_SECONDS, and above MIN_FLUX to stay quiet in silence.
+static const double THRESHOLD_SECONDS = 1;
+static const double THRESHOLD_K = 2;
+static const double MIN_FLUX = 0.01;
+
+static const double ODF_SECONDS = 8;
+static const double TEMPO_UPDATE_SECONDS = 0.5;
+// The tempo is only reported once this much flux history has been seen.
+static const double WARMUP_SECONDS = 4;
+
+static const double MIN_BPM = 60;
+static const double MAX_BPM = 200;
+// Tempo prior: log-normal around PRIOR_BPM, PRIOR_OCTAVES wide, to settle
+// the choice between a tempo and its multiples.
+static const double PRIOR_BPM = 120;
+static const double PRIOR_OCTAVES = 1;
+// Two estimates within this ratio are considered the same tempo.
+static const double SAME_TEMPO = 0.05;
+static const double PHASE_GAIN = 0.5;
+
+BeatTracker::BeatTracker(double frame_rate) : frame_rate(frame_rate) {
+  odf.assign(std::max<size_t>(std::lround(ODF_SECONDS * frame_rate), 4), 0);
+  history.assign(odf.size(), 0);
+  min_lag = std::max<long>(std::lround(60 * frame_rate / MAX_BPM), 2);
+  max_lag = std::max<long>(std::lround(60 * frame_rate / MIN_BPM), min_lag);
+  // score() looks up to twice max_lag + 1, see update_tempo().
+  acf.assign(2 * max_lag + 3, 0);
+  prior.assign(max_lag + 2, 0);
+  double prior_lag = 60 * frame_rate / PRIOR_BPM;
+  for (size_t lag = 1; lag < prior.size(); lag++) {
+    double octaves = log2(lag / prior_lag) / PRIOR_OCTAVES;
+    prior[lag] = exp(-0.5 * octaves * octaves);
+  }
+  reset();
+}
+
+void BeatTracker::reset() {
+  frames_seen = 0;
+  previous.clear();
+  level = 0;
+  std::fill(odf.begin(), odf.end(), 0);
+  odf_head = 0;
+  period = 0;
+  candidate = 0;
+  current = BeatState();
+}
+
+double BeatTracker::odf_at(size_t age) const {
+  return odf[(odf_head + odf.size() - age % odf.size()) % odf.size()];
+}
+
+double BeatTracker::flux_of(const double *spectrum, size_t bins) {
+  bool first = previous.size() != bins;
+  if (first) {
+    previous.assign(bins, 0);
+  }
+
+  double peak = bins != 0 ? *std::max_element(spectrum, spectrum + bins) : 0;
+  level = std::max(peak, LEVEL_DECAY * level);
+  double gain = level > 0 ? COMPRESSION / level : 0;
+
+  double flux = 0;
+  for (size_t k = 0; k < bins; k++) {
+    double value = log1p(gain * spectrum[k]);
+    double rise = value - previous[k];
+    if (rise > 0) {
+      flux += rise;
+    }
+    previous[k] = value;
+  }
+  return first || bins == 0 ? 0 : flux / bins;
+}
+
+void BeatTracker::detect_onset() {
+  // The frame before the newest one is judged, so that it can be compared
+  // with both neighbours.
+  size_t window = std::min<size_t>(std::lround(THRESHOLD_SECONDS * frame_rate),
+                                   std::min(frames_seen, odf.size()) - 1);
+  current.onset = false;
+  if (frames_seen < 3 || window == 0) {
+    return;
+  }
+
+  double sum = 0, sum_sq = 0;
+  for (size_t age = 1; age <= window; age++) {
+    double v = odf_at(age);
+    sum += v;
+    sum_sq += v * v;
+  }
+  double mean = sum / window;
+  double deviation = sqrt(std::max(sum_sq / window - mean * mean, 0.0));
+
+  double peak = odf_at(1);
+  current.onset = peak > MIN_FLUX && peak > mean + THRESHOLD_K * deviation &&
+                  peak >= odf_at(2) && peak > odf_at(0);
+}
+
+void BeatTracker::update_tempo() {
+  size_t n = std::min(frames_seen, odf.size());
+  double mean = 0;
+  for (size_t i = 0; i < n; i++) {
+    history[i] = odf_at(n - 1 - i);
+    mean += history[i];
+  }
+  mean /= n;
+  // A [1 2 1] smoothing spreads onsets falling between frames, so periods
+  // that aren't a whole number of frames correlate as well as those that are.
+  double before = history[0] - mean;
+  for (size_t i = 0; i < n; i++) {
+    double here = history[i] - mean;
+    double after = i + 1 < n ? history[i + 1] - mean : here;
+    history[i] = 0.25 * before + 0.5 * here + 0.25 * after;
+    before = here;
+  }
+
+  // Unbiased autocorrelation for lag 0 and min_lag - 1 ... 2 * max_lag + 1.
+  std::fill(acf.begin(), acf.end(), 0);
+  for (size_t lag = 0; lag < acf.size() && lag < n; lag++) {
+    if (lag != 0 && lag + 1 < min_lag) {
+      continue;
+    }
+    double sum = 0;
+    for (size_t i = lag; i < n; i++) {
+      sum += history[i] * history[i - lag];
+    }
+    acf[lag] = sum / (n - lag);
+  }
+  if (acf[0] <= 0) {
+    return;
+  }
+
+  // Periodic onsets also correlate at twice the period, which counts
+  // towards the shorter lag.
+  auto score = [&](size_t lag) {
+    return prior[lag] * (acf[lag] + 0.5 * acf[2 * lag]);
+  };
+  size_t best = min_lag;
+  for (size_t lag = min_lag + 1; lag <= max_lag; lag++) {
+    if (score(lag) > score(best)) {
+      best = lag;
+    }
+  }
+  if (acf[best] <= 0) {
+    return;
+  }
+
+  // Parabolic interpolation for a period between whole frames.
+  double estimate = best;
+  double left = score(best - 1), middle = score(best), right = score(best + 1);
+  double curvature = left - 2 * middle + right;
+  if (curvature < 0) {
+    estimate += std::clamp(0.5 * (left - right) / curvature, -0.5, 0.5);
+  }
+
+  // A tempo change is only taken on two agreeing estimates in a row.
+  if (period == 0) {
+    period = estimate;
+  } else if (std::abs(estimate / period - 1) < SAME_TEMPO) {
+    period = 0.8 * period + 0.2 * estimate;
+    candidate = 0;
+  } else if (candidate != 0 && std::abs(estimate / candidate - 1) < SAME_TEMPO) {
+    period = estimate;
+    candidate = 0;
+  } else {
+    candidate = estimate;
+  }
+  current.confidence = std::clamp(acf[best] / acf[0], 0.0, 1.0);
+}
+
+void BeatTracker::align_phase() {
+  // Comb over the history: the offset whose beat positions collect the
+  // most onset strength is the time since the last beat.
+  size_t n = std::min(frames_seen, odf.size());
+  size_t offsets = std::min<size_t>(std::ceil(period), n);
+  size_t best = 0;
+  double best_sum = -1;
+  for (size_t offset = 0; offset < offsets; offset++) {
+    double sum = 0;
+    for (double age = offset; age < n; age += period) {
+      sum += odf_at(std::lround(age));
+    }
+    if (sum > best_sum) {
+      best_sum = sum;
+      best = offset;
+    }
+  }
+
+  double measured = best / period;
+  if (current.bpm == 0) {
+    current.phase = measured;
+    return;
+  }
+  double error = measured - current.phase;
+  error -= std::floor(error + 0.5);
+  current.phase += PHASE_GAIN * error;
+  current.phase -= std::floor(current.phase);
+}
+
+const BeatState &BeatTracker::process(const double *spectrum, size_t bins) {
+  current.flux = flux_of(spectrum, bins);
+  odf_head = (odf_head + 1) % odf.size();
+  odf[odf_head] = current.flux;
+  frames_seen++;
+  detect_onset();
+
+  if (period > 0) {
+    current.phase += 1 / period;
+    current.phase -= std::floor(current.phase);
+  }
+
+  size_t update_every = std::max<long>(std::lround(TEMPO_UPDATE_SECONDS *
+                                                   frame_rate), 1);
+  if (frames_seen >= WARMUP_SECONDS * frame_rate &&
+      frames_seen % update_every == 0) {
+    update_tempo();
+    if (period > 0) {
+      align_phase();
+      current.bpm = 60 * frame_rate / period;
+    }
+  }
+  return current;
+}
+
+double BeatTracker::pulse() const {
+  if (current.bpm == 0) {
+    return 0;
+  }
+  double decay = 1 - current.phase;
+  return std::min(1.0, 2 * current.confidence) * decay * decay * decay * decay;
+}
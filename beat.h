@@ -0,0 +1,64 @@
+#ifndef _AUDIO_VISUALIZER_BEAT_H_
+#define _AUDIO_VISUALIZER_BEAT_H_
+
+#include <cstddef>
+#include <vector>
+
+struct BeatState {
+  double flux = 0;       // onset strength of the newest frame
+  bool onset = false;    // an onset peaked on the previous frame
+  double bpm = 0;        // 0 until enough history has been seen
+  double phase = 0;      // [0, 1), 0 on a predicted beat
+  double confidence = 0; // 0 ... 1
+};
+
+// Onset detection from the log spectral flux of successive magnitude spectra,
+// with a threshold following the local mean and deviation of the flux, and a
+// tempo/beat tracker on the flux history: a tempo-weighted autocorrelation
+// picks the beat period, a comb over the history aligns the phase, which then
+// runs freely between updates. All buffers are sized in the constructor and
+// when the bin count changes, process() never allocates.
+class BeatTracker {
+public:
+  explicit BeatTracker(double frame_rate);
+
+  // Forgets all history, call after a seek or when a new file starts.
+  void reset();
+
+  // spectrum is one frame of magnitudes, newest last in time.
+  const BeatState &process(const double *spectrum, size_t bins);
+
+  const BeatState &state() const { return current; }
+
+  // Brightness boost for the visuals, 1 on a beat decaying to 0 in between.
+  double pulse() const;
+
+private:
+  double flux_of(const double *spectrum, size_t bins);
+  void detect_onset();
+  void update_tempo();
+  void align_phase();
+  double odf_at(size_t age) const;
+
+  double frame_rate;
+  size_t frames_seen = 0;
+
+  std::vector<double> previous; // log-compressed previous spectrum
+  double level = 0;             // slowly adapting spectrum peak
+
+  // Onset strength history, ring written at odf_head, odf[odf_head] newest.
+  std::vector<double> odf;
+  size_t odf_head = 0;
+  std::vector<double> history; // odf unrolled oldest first, mean removed
+
+  size_t min_lag, max_lag;
+  std::vector<double> acf; // indexed by lag
+  std::vector<double> prior;
+
+  double period = 0;    // frames per beat
+  double candidate = 0; // period waiting for a second opinion
+
+  BeatState current;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "channels.h"
+#include "converter.h"
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+size_t deinterleave(const uint8_t *bytes, size_t num_bytes,
+                    SDL_AudioFormat format, int channels, double *left,
+                    double *right) {
+  size_t byte_size = sample_byte_size(format);
+  size_t n = num_bytes / (byte_size * channels);
+  size_t i = 0;
+
+#ifdef __SSE2__
+  if (format == AUDIO_S16 && channels == 2) {
+    // 4 stereo frames per iteration: sign-extend L0 R0 L1 R1 to int32,
+    // regroup as L0 L1 R0 R1 and convert each pair to doubles.
+    for (; i + 4 <= n; i += 4) {
+      __m128i pcm = _mm_loadu_si128((const __m128i *)(bytes + 4 * i));
+      __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(pcm, pcm), 16);
+      __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(pcm, pcm), 16);
+      lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+      hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+      _mm_storeu_pd(left + i, _mm_cvtepi32_pd(lo));
+      _mm_storeu_pd(right + i, _mm_cvtepi32_pd(_mm_unpackhi_epi64(lo, lo)));
+      _mm_storeu_pd(left + i + 2, _mm_cvtepi32_pd(hi));
+      _mm_storeu_pd(right + i + 2,
+                    _mm_cvtepi32_pd(_mm_unpackhi_epi64(hi, hi)));
+    }
+  }
+#endif
+
+  size_t frame_bytes = byte_size * channels;
+  for (; i < n; i++) {
+    const uint8_t *frame = bytes + i * frame_bytes;
+    left[i] = from_bytes(frame, format);
+    right[i] = channels > 1 ? from_bytes(frame + byte_size, format) : left[i];
+  }
+  return n;
+}
+
+void mix_channels(int mode, const double *left, const double *right,
+                  size_t n, double *out) {
+  double l_gain, r_gain;
+  switch (mode) {
+  case CHANNEL_SIDE:
+    l_gain = 0.5, r_gain = -0.5;
+    break;
+  case CHANNEL_LEFT:
+    l_gain = 1, r_gain = 0;
+    break;
+  case CHANNEL_RIGHT:
+    l_gain = 0, r_gain = 1;
+    break;
+  case CHANNEL_MID:
+  default:
+    l_gain = 0.5, r_gain = 0.5;
+    break;
+  }
+
+  size_t i = 0;
+#ifdef __SSE2__
+  __m128d lg = _mm_set1_pd(l_gain), rg = _mm_set1_pd(r_gain);
+  for (; i + 2 <= n; i += 2) {
+    __m128d l = _mm_mul_pd(_mm_loadu_pd(left + i), lg);
+    __m128d r = _mm_mul_pd(_mm_loadu_pd(right + i), rg);
+    _mm_storeu_pd(out + i, _mm_add_pd(l, r));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = l_gain * left[i] + r_gain * right[i];
+  }
+}
+
+StereoStats stereo_stats(const double *left, const double *right, size_t n) {
+  double ll = 0, rr = 0, lr = 0, sum_l = 0, sum_r = 0;
+  size_t i = 0;
+#ifdef __SSE2__
+  __m128d vll = _mm_setzero_pd(), vrr = _mm_setzero_pd(),
+          vlr = _mm_setzero_pd(), vl = _mm_setzero_pd(),
+          vr = _mm_setzero_pd();
+  for (; i + 2 <= n; i += 2) {
+    __m128d l = _mm_loadu_pd(left + i);
+    __m128d r = _mm_loadu_pd(right + i);
+    vll = _mm_add_pd(vll, _mm_mul_pd(l, l));
+    vrr = _mm_add_pd(vrr, _mm_mul_pd(r, r));
+    vlr = _mm_add_pd(vlr, _mm_mul_pd(l, r));
+    vl = _mm_add_pd(vl, l);
+    vr = _mm_add_pd(vr, r);
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, vll);
+  ll = lanes[0] + lanes[1];
+  _mm_storeu_pd(lanes, vrr);
+  rr = lanes[0] + lanes[1];
+  _mm_storeu_pd(lanes, vlr);
+  lr = lanes[0] + lanes[1];
+  _mm_storeu_pd(lanes, vl);
+  sum_l = lanes[0] + lanes[1];
+  _mm_storeu_pd(lanes, vr);
+  sum_r = lanes[0] + lanes[1];
+#endif
+  for (; i < n; i++) {
+    ll += left[i] * left[i];
+    rr += right[i] * right[i];
+    lr += left[i] * right[i];
+    sum_l += left[i];
+    sum_r += right[i];
+  }
+
+  StereoStats stats;
+  if (n == 0) {
+    return stats;
+  }
+  // Unsigned formats carry a DC offset, take it out of the moments.
+  double mean_l = sum_l / n, mean_r = sum_r / n;
+  double var_l = ll / n - mean_l * mean_l;
+  double var_r = rr / n - mean_r * mean_r;
+  double cov = lr / n - mean_l * mean_r;
+  if (var_l > 0 && var_r > 0) {
+    stats.correlation = cov / std::sqrt(var_l * var_r);
+  }
+  // mid = (L + R) / 2, side = (L - R) / 2
+  double mid = (var_l + var_r + 2 * cov) / 4;
+  double side = (var_l + var_r - 2 * cov) / 4;
+  if (mid > 0) {
+    stats.width = std::sqrt(std::max(side, 0.0) / mid);
+  } else if (side > 0) {
+    stats.width = INFINITY;
+  }
+  return stats;
+}
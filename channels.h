@@ -0,0 +1,32 @@
+#ifndef _AUDIO_VISUALIZER_CHANNELS_H_
+#define _AUDIO_VISUALIZER_CHANNELS_H_
+
+#include <SDL_audio.h>
+#include <cstddef>
+#include <cstdint>
+
+#define CHANNEL_MID 0 // (L + R) / 2, what a mono mixdown gives.
+#define CHANNEL_SIDE 1
+#define CHANNEL_LEFT 2
+#define CHANNEL_RIGHT 3
+
+struct StereoStats {
+  // Pearson correlation of L and R: 1 is mono, 0 unrelated, -1 out of phase.
+  double correlation = 1;
+  // RMS(side) / RMS(mid): 0 for mono material, infinite for pure side.
+  double width = 0;
+};
+
+// Splits interleaved 1- or 2-channel PCM into left and right in one pass,
+// mono input is copied to both. Returns the number of sample frames written.
+size_t deinterleave(const uint8_t *bytes, size_t num_bytes,
+                    SDL_AudioFormat format, int channels, double *left,
+                    double *right);
+
+// Writes the signal of `mode` (one of the CHANNEL_* defines) to out.
+void mix_channels(int mode, const double *left, const double *right,
+                  size_t n, double *out);
+
+StereoStats stereo_stats(const double *left, const double *right, size_t n);
+
+#endif
@@ -1,5 +1,6 @@
 #include "converter.h"
 #include <SDL_audio.h>
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstring>
@@ -53,7 +54,8 @@ static SDL_AudioFormat format_from_mpg123(int encoding) {
   }
 }
 
-PCM_data from_mp3(const char *filename) {
+PCM_data from_mp3(const char *filename,
+                  const std::function<bool(double)> &progress) {
   PCM_data result;
   int encoding;
 
@@ -90,11 +92,28 @@ PCM_data from_mp3(const char *filename) {
   size_t buffer_size = mpg123_outblock(mh);
   std::vector<uint8_t> buffer(buffer_size, 0);
 
+  // Samples per channel, an estimate for files without a Xing/Info header.
+  off_t length = mpg123_length(mh);
+  size_t total_bytes = 0;
+  if (length > 0) {
+    total_bytes = length * result.channels * mpg123_encsize(encoding);
+    result.bytes.reserve(total_bytes);
+  }
+
   size_t buffer_read;
   do {
     err = mpg123_read(mh, buffer.data(), buffer_size, &buffer_read);
     result.bytes.insert(result.bytes.end(), buffer.begin(),
                         buffer.begin() + buffer_read);
+    if (progress != nullptr &&
+        !progress(total_bytes != 0
+                      ? std::min(1.0, (double)result.bytes.size() / total_bytes)
+                      : -1)) {
+      cleanup(mh);
+      std::stringstream ss;
+      ss << "Decoding of " << filename << " cancelled";
+      throw std::runtime_error(ss.str());
+    }
   } while (buffer_read && err == MPG123_OK);
 
   if (err != MPG123_DONE) {
@@ -115,3 +134,45 @@ PCM_data from_mp3(const char *filename) {
   assert(result.rate > 0);
   return result;
 }
+
+size_t sample_byte_size(SDL_AudioFormat format) {
+  return (SDL_AUDIO_MASK_BITSIZE & format) / 8;
+}
+
+double from_bytes(const uint8_t *bytes, SDL_AudioFormat format) {
+  switch (format) {
+  case AUDIO_S16:
+    return *(reinterpret_cast<const int16_t *>(bytes));
+  case AUDIO_U16:
+    return *(reinterpret_cast<const uint16_t *>(bytes));
+  case AUDIO_U8:
+    return *bytes;
+  case AUDIO_S8:
+    return *(reinterpret_cast<const int8_t *>(bytes));
+  case AUDIO_S32:
+    return *(reinterpret_cast<const int32_t *>(bytes));
+  default:
+    assert(false);
+    return 0;
+  }
+}
+
+std::vector<double> mono_samples(const uint8_t *bytes, size_t num_bytes,
+                                 SDL_AudioFormat format, int channels) {
+  size_t byte_size = sample_byte_size(format);
+  size_t num_samples = num_bytes / (byte_size * channels);
+
+  std::vector<double> result(num_samples, 0);
+
+  size_t processed = 0;
+  for (size_t i = 0; i < num_samples; i++) {
+    for (int ch = 0; ch < channels; ch++) {
+      result[i] += from_bytes(bytes + processed, format);
+      processed += byte_size;
+    }
+    result[i] /= channels;
+  }
+  assert(num_bytes == processed);
+
+  return result;
+}
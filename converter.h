@@ -3,6 +3,7 @@
 
 #include <SDL_audio.h>
 #include <cstdint>
+#include <functional>
 #include <vector>
 #include <memory>
 
@@ -14,6 +15,19 @@ struct PCM_data {
   size_t processed_bytes;
 };
 
-PCM_data from_mp3(const char *filename);
+// `progress` is called as decoding goes with the decoded fraction of the
+// file, or -1 when its length isn't known. Returning false from it stops
+// decoding, from_mp3 then throws.
+PCM_data from_mp3(const char *filename,
+                  const std::function<bool(double)> &progress = nullptr);
+
+size_t sample_byte_size(SDL_AudioFormat format);
+
+double from_bytes(const uint8_t *bytes, SDL_AudioFormat format);
+
+// Averages all channels of interleaved PCM into one double per sample frame,
+// so the result stays in the range of a single channel.
+std::vector<double> mono_samples(const uint8_t *bytes, size_t num_bytes,
+                                 SDL_AudioFormat format, int channels);
 
 #endif // _AUDIO_VISUALIZER_CONVERTER_H_
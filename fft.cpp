@@ -1,34 +1,167 @@
 #include "fft.h"
 #include <cmath>
 #include <fftw3.h>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #define RE_IDX 0
 #define IM_IDX 1
 
-std::vector<double> amplitudes_of_harmonics(std::vector<double> &wave_values) {
-  size_t n = wave_values.size();
+// The FFTW planner isn't thread-safe, only fftw_execute*() is. Plans are
+// created once per (size, batch, threads) and reused with the new-array
+// interface, so every caller must pass arrays laid out like the plan's.
+static std::mutex planner_lock;
+static std::map<std::tuple<size_t, size_t, size_t>, fftw_plan> r2c_plans;
+static std::map<size_t, fftw_plan> c2r_plans;
+static bool threads_initialized = false;
 
-  fftw_complex *out = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * n);
-  if (out == nullptr) {
+static fftw_plan r2c_plan(size_t n, size_t howmany = 1, size_t threads = 1) {
+  std::lock_guard<std::mutex> guard(planner_lock);
+  auto key = std::make_tuple(n, howmany, threads);
+  auto it = r2c_plans.find(key);
+  if (it != r2c_plans.end()) {
+    return it->second;
+  }
+
+  size_t out_n = n / 2 + 1;
+  double *in = (double *)fftw_malloc(sizeof(double) * n * howmany);
+  fftw_complex *out =
+      (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * out_n * howmany);
+  if (in == nullptr || out == nullptr) {
     printf("Error: fftw_malloc()\n");
     exit(2);
   }
 
-  fftw_plan plan =
-      fftw_plan_dft_r2c_1d(n, wave_values.data(), out, FFTW_ESTIMATE);
+  if (threads > 1 && !threads_initialized) {
+    if (fftw_init_threads() == 0) {
+      printf("Error: fftw_init_threads()\n");
+      exit(2);
+    }
+    threads_initialized = true;
+  }
+  if (threads_initialized) {
+    fftw_plan_with_nthreads(threads);
+  }
+
+  fftw_plan plan;
+  if (howmany == 1) {
+    plan = fftw_plan_dft_r2c_1d(n, in, out, FFTW_ESTIMATE | FFTW_UNALIGNED);
+  } else {
+    int size = n;
+    plan = fftw_plan_many_dft_r2c(1, &size, howmany, in, nullptr, 1, n, out,
+                                  nullptr, 1, out_n,
+                                  FFTW_ESTIMATE | FFTW_UNALIGNED);
+  }
+  fftw_free(in);
+  fftw_free(out);
 
-  fftw_execute(plan);
-  fftw_destroy_plan(plan);
+  r2c_plans[key] = plan;
+  return plan;
+}
 
-  std::vector<double> result = std::vector<double>(n / 2, 0);
-  for (size_t i = 0; i < n / 2; i++) {
-    result[i] =
-        sqrt(out[i][RE_IDX] * out[i][RE_IDX] + out[i][IM_IDX] * out[i][IM_IDX]);
+static fftw_plan c2r_plan(size_t n) {
+  std::lock_guard<std::mutex> guard(planner_lock);
+  auto it = c2r_plans.find(n);
+  if (it != c2r_plans.end()) {
+    return it->second;
   }
 
+  fftw_complex *in = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) *
+                                                 (n / 2 + 1));
+  double *out = (double *)fftw_malloc(sizeof(double) * n);
+  if (in == nullptr || out == nullptr) {
+    printf("Error: fftw_malloc()\n");
+    exit(2);
+  }
+  if (threads_initialized) {
+    fftw_plan_with_nthreads(1);
+  }
+  // c2r plans overwrite their input, callers pass scratch spectra only.
+  fftw_plan plan =
+      fftw_plan_dft_c2r_1d(n, in, out, FFTW_ESTIMATE | FFTW_UNALIGNED);
+  fftw_free(in);
   fftw_free(out);
 
+  c2r_plans[n] = plan;
+  return plan;
+}
+
+static void magnitudes(const fftw_complex *spectrum, size_t bins,
+                       double *out) {
+  for (size_t i = 0; i < bins; i++) {
+    out[i] = sqrt(spectrum[i][RE_IDX] * spectrum[i][RE_IDX] +
+                  spectrum[i][IM_IDX] * spectrum[i][IM_IDX]);
+  }
+}
+
+FftStrategy fft_strategy(size_t n, size_t count, size_t threads) {
+  if (n >= LARGE_FFT_SIZE && threads > 1) {
+    return FFT_THREADED;
+  }
+  return count > 1 ? FFT_BATCHED : FFT_SINGLE;
+}
+
+void amplitudes_of_frames(const double *frames, size_t n, size_t count,
+                          double *out, size_t threads) {
+  FftStrategy strategy = fft_strategy(n, count, threads);
+  size_t batch = strategy == FFT_BATCHED ? FFT_BATCH : 1;
+  size_t out_n = n / 2 + 1;
+
+  fftw_complex *spectra =
+      (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * out_n * batch);
+  if (spectra == nullptr) {
+    printf("Error: fftw_malloc()\n");
+    exit(2);
+  }
+
+  size_t howmany;
+  for (size_t first = 0; first < count; first += howmany) {
+    // A short tail runs frame by frame rather than planning another batch.
+    howmany = count - first >= batch ? batch : 1;
+    fftw_plan plan = r2c_plan(n, howmany,
+                              strategy == FFT_THREADED ? threads : 1);
+    // The input is only read: r2c plans preserve their input by default.
+    fftw_execute_dft_r2c(plan, const_cast<double *>(frames + first * n),
+                         spectra);
+    for (size_t k = 0; k < howmany; k++) {
+      magnitudes(spectra + k * out_n, n / 2, out + (first + k) * (n / 2));
+    }
+  }
+
+  fftw_free(spectra);
+}
+
+std::vector<double> amplitudes_of_harmonics(std::vector<double> &wave_values) {
+  size_t n = wave_values.size();
+  std::vector<double> result = std::vector<double>(n / 2, 0);
+  amplitudes_of_frames(wave_values.data(), n, 1, result.data(),
+                       n >= LARGE_FFT_SIZE ? std::thread::hardware_concurrency()
+                                           : 1);
   return result;
-}
\ No newline at end of file
+}
+
+void cross_correlation(const double *a, const double *b, size_t n,
+                       double *out) {
+  // Scratch spectra are kept per thread and only grow, so steady callers
+  // don't allocate.
+  thread_local std::vector<std::complex<double>> spectrum_a, spectrum_b;
+  size_t bins = n / 2 + 1;
+  if (spectrum_a.size() < bins) {
+    spectrum_a.resize(bins);
+    spectrum_b.resize(bins);
+  }
+  fftw_complex *fa = reinterpret_cast<fftw_complex *>(spectrum_a.data());
+  fftw_complex *fb = reinterpret_cast<fftw_complex *>(spectrum_b.data());
+
+  fftw_plan forward = r2c_plan(n);
+  fftw_execute_dft_r2c(forward, const_cast<double *>(a), fa);
+  fftw_execute_dft_r2c(forward, const_cast<double *>(b), fb);
+  for (size_t k = 0; k < bins; k++) {
+    spectrum_a[k] = std::conj(spectrum_a[k]) * spectrum_b[k] / (double)n;
+  }
+  fftw_execute_dft_c2r(c2r_plan(n), fa, out);
+}
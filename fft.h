@@ -10,4 +10,29 @@ const uint64_t MAX_FFT_OUTPUT = 11000000; // Value for 50 FPS (50Hz FFT resoluti
 
 std::vector<double> amplitudes_of_harmonics(std::vector<double> &wave_values);
 
+// From this size up a single transform is worth splitting across threads.
+const size_t LARGE_FFT_SIZE = 65536;
+
+enum FftStrategy {
+  FFT_SINGLE,   // one fftw_plan_dft_r2c_1d per frame
+  FFT_BATCHED,  // fftw_plan_many_dft_r2c over up to FFT_BATCH frames
+  FFT_THREADED, // one frame at a time, each transform on `threads` threads
+};
+
+const size_t FFT_BATCH = 32;
+
+FftStrategy fft_strategy(size_t n, size_t count, size_t threads);
+
+// Magnitudes of `count` frames of n samples stored back to back in `frames`.
+// Writes count rows of n / 2 magnitudes to `out`. `threads` is how many
+// threads a single transform may use.
+void amplitudes_of_frames(const double *frames, size_t n, size_t count,
+                          double *out, size_t threads = 1);
+
+// Circular cross-correlation out[tau] = sum_j a[j] * b[(j + tau) % n] of two
+// n-sample signals, through cached r2c and c2r plans. Zero-pad the inputs for
+// a linear correlation.
+void cross_correlation(const double *a, const double *b, size_t n,
+                       double *out);
+
 #endif
\ No newline at end of file
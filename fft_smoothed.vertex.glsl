@@ -0,0 +1,24 @@
+attribute float index; // of the bin
+uniform float bins;
+uniform sampler2D state;
+uniform float peaks; // 1 draws the peak-hold markers, 0 the smoothed line
+varying vec4 f_color;
+
+#define LIMIT 0.2
+#define FALL_FAST 0.25
+
+void main(void) {
+	vec4 s = texture2DLod(state, vec2((index + 0.5) / bins, 0.5), 0.0);
+	float y = mix(s.r, s.g, peaks);
+	gl_Position = vec4(2.0 * index / max(bins - 1.0, 1.0) - 1.0, y, 0, 1);
+
+    if (peaks > 0.5) {
+        f_color = vec4(1.0, 1.0, 1.0, 1.0);
+    } else if (y <= LIMIT) {
+        float frac = y / LIMIT;
+        f_color = vec4(frac, 1.0, 0.5 * frac, 1.0);
+    } else {
+        float frac = (y - LIMIT) / (1.0 - LIMIT);
+        f_color = vec4(1.0, (1.0 - frac) * FALL_FAST, 0.5 * (1.0 - frac) * FALL_FAST, 1.0);
+    }
+}
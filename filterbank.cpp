@@ -0,0 +1,158 @@
+#include "filterbank.h"
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Appends a triangle rising from left_hz to 1 at center_hz and falling back
+// to 0 at right_hz. The slopes are at least one bin wide so that the band
+// always touches a bin.
+static void add_triangle(Filterbank &fb, double bin_hz, double left_hz,
+                         double center_hz, double right_hz) {
+  left_hz = std::min(left_hz, center_hz - bin_hz);
+  right_hz = std::max(right_hz, center_hz + bin_hz);
+
+  long first = std::max(0l, (long)std::ceil(left_hz / bin_hz));
+  long last = std::min((long)fb.bins - 1, (long)std::floor(right_hz / bin_hz));
+
+  std::vector<double> band;
+  for (long i = first; i <= last; i++) {
+    double f = i * bin_hz;
+    double w = f <= center_hz ? (f - left_hz) / (center_hz - left_hz)
+                              : (right_hz - f) / (right_hz - center_hz);
+    band.push_back(std::max(0.0, w));
+  }
+
+  // Trim zero weights at the edges, they'd only cost multiplications.
+  while (!band.empty() && band.back() == 0) {
+    band.pop_back();
+  }
+  size_t skip = 0;
+  while (skip < band.size() && band[skip] == 0) {
+    skip++;
+  }
+  first += skip;
+  band.erase(band.begin(), band.begin() + skip);
+
+  if (band.empty()) {
+    first = std::clamp((long)std::lround(center_hz / bin_hz), 0l,
+                       (long)fb.bins - 1);
+    band.push_back(1);
+  }
+
+  double sum = 0;
+  for (double w : band) {
+    sum += w;
+  }
+  fb.first_bin.push_back(first);
+  fb.center_hz.push_back(center_hz);
+  for (double w : band) {
+    fb.weights.push_back(w / sum);
+  }
+  fb.offset.push_back(fb.weights.size());
+}
+
+Filterbank log_filterbank(size_t bins, double bin_hz, size_t bands,
+                          double fmin, double fmax) {
+  Filterbank fb;
+  fb.bins = bins;
+  fb.offset.push_back(0);
+
+  // Band centers are spaced evenly in log(f); neighbouring centers are the
+  // triangle edges, so every band has the same Q.
+  double ratio = std::pow(fmax / fmin, 1.0 / (bands + 1));
+  for (size_t b = 1; b <= bands; b++) {
+    double center = fmin * std::pow(ratio, b);
+    add_triangle(fb, bin_hz, center / ratio, center, center * ratio);
+  }
+  return fb;
+}
+
+static double hz_to_mel(double hz) { return 2595 * std::log10(1 + hz / 700); }
+
+static double mel_to_hz(double mel) {
+  return 700 * (std::pow(10, mel / 2595) - 1);
+}
+
+Filterbank mel_filterbank(size_t bins, double bin_hz, size_t bands,
+                          double fmin, double fmax) {
+  Filterbank fb;
+  fb.bins = bins;
+  fb.offset.push_back(0);
+
+  double mel_min = hz_to_mel(fmin);
+  double mel_step = (hz_to_mel(fmax) - mel_min) / (bands + 1);
+  for (size_t b = 1; b <= bands; b++) {
+    add_triangle(fb, bin_hz, mel_to_hz(mel_min + (b - 1) * mel_step),
+                 mel_to_hz(mel_min + b * mel_step),
+                 mel_to_hz(mel_min + (b + 1) * mel_step));
+  }
+  return fb;
+}
+
+static double note_to_hz(double note) {
+  return 440 * std::pow(2, (note - 69) / 12);
+}
+
+Filterbank semitone_filterbank(size_t bins, double bin_hz, int first_note,
+                               int last_note) {
+  Filterbank fb;
+  fb.bins = bins;
+  fb.offset.push_back(0);
+
+  for (int note = first_note; note <= last_note; note++) {
+    add_triangle(fb, bin_hz, note_to_hz(note - 1), note_to_hz(note),
+                 note_to_hz(note + 1));
+  }
+  return fb;
+}
+
+void fold_chroma(const double *semitones, size_t n, int first_note,
+                 double *chroma) {
+  int count[CHROMA_BINS] = {};
+  for (int c = 0; c < CHROMA_BINS; c++) {
+    chroma[c] = 0;
+  }
+  for (size_t i = 0; i < n; i++) {
+    int pitch_class = (first_note + i) % CHROMA_BINS;
+    chroma[pitch_class] += semitones[i];
+    count[pitch_class]++;
+  }
+  for (int c = 0; c < CHROMA_BINS; c++) {
+    if (count[c] != 0) {
+      chroma[c] /= count[c];
+    }
+  }
+}
+
+static double dot(const double *a, const double *b, size_t n) {
+  size_t i = 0;
+  double result = 0;
+#ifdef __SSE2__
+  __m128d acc0 = _mm_setzero_pd();
+  __m128d acc1 = _mm_setzero_pd();
+  for (; i + 4 <= n; i += 4) {
+    acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i),
+                                       _mm_loadu_pd(b + i)));
+    acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2),
+                                       _mm_loadu_pd(b + i + 2)));
+  }
+  __m128d acc = _mm_add_pd(acc0, acc1);
+  result = _mm_cvtsd_f64(_mm_add_sd(acc, _mm_unpackhi_pd(acc, acc)));
+#endif
+  for (; i < n; i++) {
+    result += a[i] * b[i];
+  }
+  return result;
+}
+
+void apply_filterbank(const Filterbank &filterbank, const double *spectrum,
+                      double *out) {
+  for (size_t b = 0; b < filterbank.bands(); b++) {
+    size_t begin = filterbank.offset[b];
+    size_t length = filterbank.offset[b + 1] - begin;
+    out[b] = dot(filterbank.weights.data() + begin,
+                 spectrum + filterbank.first_bin[b], length);
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef _AUDIO_VISUALIZER_FILTERBANK_H_
+#define _AUDIO_VISUALIZER_FILTERBANK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Sparse bin -> band weight matrix. Every band reads a contiguous run of
+// bins: band b covers bins [first_bin[b], first_bin[b] + length(b)) with
+// weights[offset[b]] ... weights[offset[b + 1] - 1].
+struct Filterbank {
+  size_t bins = 0;
+  std::vector<uint32_t> first_bin;
+  std::vector<uint32_t> offset;
+  std::vector<double> weights;
+  std::vector<double> center_hz;
+
+  size_t bands() const { return first_bin.size(); }
+};
+
+// `bands` log-spaced triangular bands between fmin and fmax (Hz) over a
+// spectrum of `bins` bins `bin_hz` apart. Each band's weights sum to 1, so
+// band values stay on the same scale as the input magnitudes. Bands narrower
+// than a bin interpolate between the neighbouring bins.
+Filterbank log_filterbank(size_t bins, double bin_hz, size_t bands,
+                          double fmin, double fmax);
+
+// `bands` triangular bands evenly spaced on the mel scale between fmin and
+// fmax, normalized like log_filterbank().
+Filterbank mel_filterbank(size_t bins, double bin_hz, size_t bands,
+                          double fmin, double fmax);
+
+// One band per equal-tempered semitone (A4 = 440 Hz) from MIDI note
+// first_note to last_note inclusive. Feed the result to fold_chroma().
+Filterbank semitone_filterbank(size_t bins, double bin_hz, int first_note,
+                               int last_note);
+
+const int CHROMA_BINS = 12;
+
+// Averages semitone bands over octaves into CHROMA_BINS pitch classes,
+// chroma[0] being C.
+void fold_chroma(const double *semitones, size_t n, int first_note,
+                 double *chroma);
+
+// out[b] = sum of weights * spectrum over band b, for every band.
+void apply_filterbank(const Filterbank &filterbank, const double *spectrum,
+                      double *out);
+
+#endif
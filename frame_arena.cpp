@@ -0,0 +1,33 @@
+#include "frame_arena.h"
+#include <algorithm>
+
+FrameArena frame_arena(1 << 20);
+
+FrameArena::FrameArena(size_t initial_capacity)
+    : block(new uint8_t[initial_capacity]), block_size(initial_capacity) {}
+
+void FrameArena::reset() {
+  if (!overflow.empty()) {
+    overflow.clear();
+    // Headroom for alignment padding and slowly growing frames.
+    block_size = high_water_bytes + high_water_bytes / 4;
+    block.reset(new uint8_t[block_size]);
+  }
+  offset = 0;
+  used_bytes = 0;
+}
+
+void *FrameArena::alloc_bytes(size_t bytes, size_t align) {
+  used_bytes += bytes;
+  high_water_bytes = std::max(high_water_bytes, used_bytes);
+
+  size_t start = (offset + align - 1) & ~(align - 1);
+  if (start + bytes <= block_size) {
+    offset = start + bytes;
+    return block.get() + start;
+  }
+
+  // new[] memory is aligned for any fundamental type.
+  overflow.emplace_back(new uint8_t[std::max<size_t>(bytes, 1)]);
+  return overflow.back().get();
+}
@@ -0,0 +1,49 @@
+#ifndef _AUDIO_VISUALIZER_FRAME_ARENA_H_
+#define _AUDIO_VISUALIZER_FRAME_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for scratch buffers that live for one rendered frame.
+// Everything allocated is released at once by reset(). When a frame needs
+// more than the current block, the overflow goes to extra blocks and the
+// next reset() replaces them all with one block big enough for the
+// high-water mark, so steady-state frames never touch the heap. Not
+// thread-safe, it belongs to the render thread.
+class FrameArena {
+public:
+  explicit FrameArena(size_t initial_capacity);
+
+  // Call at the start of every frame.
+  void reset();
+
+  // Uninitialized storage for n objects of a trivially destructible type.
+  template <typename T> T *alloc(size_t n) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "FrameArena never runs destructors");
+    return static_cast<T *>(alloc_bytes(sizeof(T) * n, alignof(T)));
+  }
+
+  size_t used() const { return used_bytes; }
+  size_t high_water() const { return high_water_bytes; }
+  size_t capacity() const { return block_size; }
+
+private:
+  void *alloc_bytes(size_t bytes, size_t align);
+
+  std::unique_ptr<uint8_t[]> block;
+  size_t block_size;
+  size_t offset = 0;
+  std::vector<std::unique_ptr<uint8_t[]>> overflow;
+
+  size_t used_bytes = 0;
+  size_t high_water_bytes = 0;
+};
+
+extern FrameArena frame_arena;
+
+#endif
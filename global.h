@@ -4,6 +4,10 @@
 #include <mutex>
 #include <SDL_stdinc.h>
 
+const int TARGET_FPS = 50;
+// Analysis frames kept for drawing.
+const int HISTORY_SIZE = 5 * TARGET_FPS;
+
 extern std::mutex big_lock;
 extern const Uint8 * keyboard_state;
 
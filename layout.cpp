@@ -0,0 +1,64 @@
+#include "layout.h"
+#include <SDL.h>
+#include <cmath>
+
+std::vector<ViewRect> tile_views(size_t count, float width, float height) {
+  std::vector<ViewRect> rects;
+  if (count == 0) {
+    return rects;
+  }
+  size_t columns = std::ceil(std::sqrt((double)count));
+  size_t rows = (count + columns - 1) / columns;
+  float w = width / columns, h = height / rows;
+  for (size_t i = 0; i < count; i++) {
+    rects.push_back(ViewRect{(i % columns) * w, (i / columns) * h, w, h});
+  }
+  return rects;
+}
+
+void set_view(const ViewRect &rect, float window_height, int below) {
+  int x = std::lround(rect.x), w = std::lround(rect.w);
+  int y = std::lround(window_height - rect.y - rect.h), h = std::lround(rect.h);
+  glScissor(x, y, w, h);
+  glViewport(x, y - below * h, w, (1 + below) * h);
+}
+
+void ViewTimer::begin() {
+  if (!initialized) {
+    initialized = true;
+    timing_gpu = GLAD_GL_VERSION_3_3;
+    if (timing_gpu) {
+      glGenQueries(QUERIES, queries);
+    }
+  }
+
+  if (timing_gpu) {
+    // The oldest query has had QUERIES - 1 frames to finish.
+    if (pending[next]) {
+      GLuint available = GL_FALSE;
+      glGetQueryObjectuiv(queries[next], GL_QUERY_RESULT_AVAILABLE,
+                          &available);
+      if (available) {
+        GLuint64 ns;
+        glGetQueryObjectui64v(queries[next], GL_QUERY_RESULT, &ns);
+        gpu = gpu < 0 ? ns / 1e6 : 0.9 * gpu + 0.1 * ns / 1e6;
+        pending[next] = false;
+      }
+    }
+    if (!pending[next]) {
+      glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+    }
+  }
+  start = SDL_GetPerformanceCounter();
+}
+
+void ViewTimer::end() {
+  double ms = 1000.0 * (SDL_GetPerformanceCounter() - start) /
+              SDL_GetPerformanceFrequency();
+  cpu = 0.9 * cpu + 0.1 * ms;
+  if (timing_gpu && !pending[next]) {
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[next] = true;
+  }
+  next = (next + 1) % QUERIES;
+}
@@ -0,0 +1,69 @@
+#ifndef _AUDIO_VISUALIZER_LAYOUT_H_
+#define _AUDIO_VISUALIZER_LAYOUT_H_
+
+#include "gl.h"
+#include <SDL_audio.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Everything the views draw from, gathered once per rendered frame so that
+// views share it instead of each copying out of the analysis history.
+struct AnalysisFrame {
+  uint64_t id = 0; // plot_frame_id of `spectrum`
+  size_t bins = 0;
+  const double *labels = nullptr; // x of every bin
+  // Newest, `bins` raw magnitudes, packed as the shaders take them.
+  const float *spectrum = nullptr;
+  double label_step = 1; // Hz per bin, 1 for feature bands
+  size_t wave_n = 0;
+  const float *wave = nullptr; // newest block of samples, unscaled
+  SDL_AudioFormat format = 0;
+  float beat_pulse = 0;
+  // The whole history for views that draw it, only valid under big_lock.
+  const std::deque<std::vector<double>> *history = nullptr;
+  // False while scrubbing through the scrollback: `history` is a snapshot
+  // that doesn't grow, and the live trackers don't belong to it.
+  bool live = true;
+};
+
+// A view's area in window coordinates, origin in the top-left corner like
+// ImGui's.
+struct ViewRect {
+  float x, y, w, h;
+};
+
+// Splits the window into a grid for `count` views, filled row by row.
+std::vector<ViewRect> tile_views(size_t count, float width, float height);
+
+// glViewport and glScissor for `rect`. `below` extends the viewport by that
+// many heights downwards, for views drawn in the upper half of clip space.
+void set_view(const ViewRect &rect, float window_height, int below = 0);
+
+// CPU and GPU time a view takes to draw, averaged over recent frames. GPU
+// times come from GL_TIME_ELAPSED queries (GL 3.3), read a few frames late
+// so that nothing waits for the GPU.
+class ViewTimer {
+public:
+  void begin();
+  void end();
+
+  double cpu_ms() const { return cpu; }
+  // Negative without timer queries.
+  double gpu_ms() const { return gpu; }
+
+private:
+  static const int QUERIES = 4;
+
+  bool initialized = false;
+  bool timing_gpu = false;
+  GLuint queries[QUERIES];
+  bool pending[QUERIES] = {};
+  int next = 0;
+  Uint64 start = 0;
+  double cpu = 0;
+  double gpu = -1;
+};
+
+#endif
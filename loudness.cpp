@@ -0,0 +1,289 @@
+#include "loudness.h"
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const double ABSOLUTE_GATE = -70;
+static const double HISTOGRAM_STEP = 0.1;
+static const size_t HISTOGRAM_BINS = 750; // -70 ... +5 LUFS
+
+static double loudness_of(double power) { return -0.691 + 10 * log10(power); }
+
+static size_t histogram_bin(double loudness) {
+  long bin = std::floor((loudness - ABSOLUTE_GATE) / HISTOGRAM_STEP);
+  return std::clamp(bin, 0l, (long)HISTOGRAM_BINS - 1);
+}
+
+void LoudnessMeter::Histogram::clear() {
+  counts.assign(HISTOGRAM_BINS, 0);
+  powers.assign(HISTOGRAM_BINS, 0);
+}
+
+void LoudnessMeter::Histogram::add(double loudness, double power) {
+  size_t bin = histogram_bin(loudness);
+  counts[bin]++;
+  powers[bin] += power;
+}
+
+LoudnessMeter::LoudnessMeter() {
+  // Windowed-sinc interpolator, split into TP_PHASES polyphase branches
+  // that each sum to one.
+  const int length = TP_PHASES * TP_TAPS;
+  const double center = (length - 1) / 2.0;
+  for (int n = 0; n < length; n++) {
+    double t = (n - center) / TP_PHASES;
+    double sinc = t == 0 ? 1 : sin(M_PI * t) / (M_PI * t);
+    double window = 0.5 - 0.5 * cos(2 * M_PI * (n + 0.5) / length);
+    fir[n % TP_PHASES][n / TP_PHASES] = sinc * window;
+  }
+  for (int p = 0; p < TP_PHASES; p++) {
+    double sum = 0;
+    for (int k = 0; k < TP_TAPS; k++) {
+      sum += fir[p][k];
+    }
+    for (int k = 0; k < TP_TAPS; k++) {
+      fir[p][k] /= sum;
+    }
+  }
+  reset(48000, AUDIO_S16, 2);
+}
+
+void LoudnessMeter::reset(long rate, SDL_AudioFormat format, int channels) {
+  switch (format) {
+  case AUDIO_U8:
+    offset = 128, scale = 1.0 / 128;
+    break;
+  case AUDIO_S8:
+    offset = 0, scale = 1.0 / 128;
+    break;
+  case AUDIO_U16:
+    offset = 32768, scale = 1.0 / 32768;
+    break;
+  case AUDIO_S32:
+    offset = 0, scale = 1.0 / 2147483648.0;
+    break;
+  case AUDIO_S16:
+  default:
+    offset = 0, scale = 1.0 / 32768;
+    break;
+  }
+  right_weight = channels > 1 ? 1 : 0;
+
+  // BS.1770 K-weighting for an arbitrary sample rate: a high shelf
+  // (stage 0) followed by the RLB high-pass (stage 1).
+  double K = tan(M_PI * 1681.974450955533 / rate);
+  double Q = 0.7071752369554196;
+  double Vh = pow(10, 3.999843853973347 / 20);
+  double Vb = pow(Vh, 0.4996667741545416);
+  double a0 = 1 + K / Q + K * K;
+  b[0][0] = (Vh + Vb * K / Q + K * K) / a0;
+  b[0][1] = 2 * (K * K - Vh) / a0;
+  b[0][2] = (Vh - Vb * K / Q + K * K) / a0;
+  a[0][1] = 2 * (K * K - 1) / a0;
+  a[0][2] = (1 - K / Q + K * K) / a0;
+
+  K = tan(M_PI * 38.13547087602444 / rate);
+  Q = 0.5003270373238773;
+  a0 = 1 + K / Q + K * K;
+  b[1][0] = 1;
+  b[1][1] = -2;
+  b[1][2] = 1;
+  a[1][1] = 2 * (K * K - 1) / a0;
+  a[1][2] = (1 - K / Q + K * K) / a0;
+  a[0][0] = a[1][0] = 1;
+
+  std::fill(&z[0][0][0], &z[0][0][0] + sizeof z / sizeof(double), 0.0);
+  std::fill(&history[0][0], &history[0][0] + sizeof history / sizeof(double),
+            0.0);
+  history_pos = 0;
+  peak = 0;
+
+  block_samples = std::max(1l, rate / 10);
+  block_fill = 0;
+  block_power = 0;
+  blocks_seen = 0;
+  gating_blocks.clear();
+  short_terms.clear();
+  last = LoudnessReading();
+}
+
+void LoudnessMeter::process(const double *left, const double *right,
+                            size_t n) {
+#ifdef __SSE2__
+  const __m128d sign_mask = _mm_set1_pd(-0.0);
+  const __m128d weights = _mm_set_pd(right_weight, 1);
+  __m128d vpeak = _mm_set1_pd(peak);
+  __m128d vb[2][3], va[2][3], vz[2][2];
+  for (int s = 0; s < 2; s++) {
+    for (int k = 0; k < 3; k++) {
+      vb[s][k] = _mm_set1_pd(b[s][k]);
+      va[s][k] = _mm_set1_pd(a[s][k]);
+    }
+    vz[s][0] = _mm_loadu_pd(z[s][0]);
+    vz[s][1] = _mm_loadu_pd(z[s][1]);
+  }
+  const __m128d voffset = _mm_set1_pd(offset), vscale = _mm_set1_pd(scale);
+
+  for (size_t i = 0; i < n; i++) {
+    // Both channels go through every stage in one register: [L, R].
+    __m128d x = _mm_mul_pd(
+        _mm_sub_pd(_mm_set_pd(right[i], left[i]), voffset), vscale);
+
+    _mm_storeu_pd(history[history_pos], x);
+    _mm_storeu_pd(history[history_pos + TP_TAPS], x);
+    const double(*window)[2] = history + history_pos + 1;
+    for (int p = 0; p < TP_PHASES; p++) {
+      __m128d acc = _mm_setzero_pd();
+      for (int k = 0; k < TP_TAPS; k++) {
+        acc = _mm_add_pd(acc, _mm_mul_pd(_mm_set1_pd(fir[p][k]),
+                                         _mm_loadu_pd(window[TP_TAPS - 1 - k])));
+      }
+      vpeak = _mm_max_pd(vpeak, _mm_andnot_pd(sign_mask, acc));
+    }
+    history_pos = (history_pos + 1) % TP_TAPS;
+
+    for (int s = 0; s < 2; s++) {
+      __m128d y = _mm_add_pd(_mm_mul_pd(vb[s][0], x), vz[s][0]);
+      vz[s][0] = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(vb[s][1], x),
+                                       _mm_mul_pd(va[s][1], y)),
+                            vz[s][1]);
+      vz[s][1] = _mm_sub_pd(_mm_mul_pd(vb[s][2], x), _mm_mul_pd(va[s][2], y));
+      x = y;
+    }
+
+    double squares[2];
+    _mm_storeu_pd(squares, _mm_mul_pd(_mm_mul_pd(x, x), weights));
+    block_power += squares[0] + squares[1];
+    if (++block_fill == block_samples) {
+      finish_block();
+    }
+  }
+
+  double peaks[2];
+  _mm_storeu_pd(peaks, vpeak);
+  peak = std::max(peaks[0], right_weight > 0 ? peaks[1] : 0);
+  for (int s = 0; s < 2; s++) {
+    _mm_storeu_pd(z[s][0], vz[s][0]);
+    _mm_storeu_pd(z[s][1], vz[s][1]);
+  }
+#else
+  for (size_t i = 0; i < n; i++) {
+    double x[2] = {(left[i] - offset) * scale, (right[i] - offset) * scale};
+
+    for (int c = 0; c < 2; c++) {
+      history[history_pos][c] = history[history_pos + TP_TAPS][c] = x[c];
+    }
+    const double(*window)[2] = history + history_pos + 1;
+    for (int p = 0; p < TP_PHASES; p++) {
+      for (int c = 0; c < 1 + (right_weight > 0); c++) {
+        double acc = 0;
+        for (int k = 0; k < TP_TAPS; k++) {
+          acc += fir[p][k] * window[TP_TAPS - 1 - k][c];
+        }
+        peak = std::max(peak, std::fabs(acc));
+      }
+    }
+    history_pos = (history_pos + 1) % TP_TAPS;
+
+    for (int s = 0; s < 2; s++) {
+      for (int c = 0; c < 2; c++) {
+        double y = b[s][0] * x[c] + z[s][0][c];
+        z[s][0][c] = b[s][1] * x[c] - a[s][1] * y + z[s][1][c];
+        z[s][1][c] = b[s][2] * x[c] - a[s][2] * y;
+        x[c] = y;
+      }
+    }
+
+    block_power += x[0] * x[0] + right_weight * x[1] * x[1];
+    if (++block_fill == block_samples) {
+      finish_block();
+    }
+  }
+#endif
+}
+
+void LoudnessMeter::finish_block() {
+  block_powers[blocks_seen % 30] = block_power / block_samples;
+  blocks_seen++;
+  block_fill = 0;
+  block_power = 0;
+
+  if (blocks_seen >= 4) {
+    double power = 0;
+    for (size_t i = 1; i <= 4; i++) {
+      power += block_powers[(blocks_seen - i) % 30];
+    }
+    power /= 4;
+    last.momentary = loudness_of(power);
+    // Momentary windows overlap by 75%, exactly the BS.1770 gating blocks.
+    if (last.momentary >= ABSOLUTE_GATE) {
+      gating_blocks.add(last.momentary, power);
+    }
+  }
+  if (blocks_seen >= 30) {
+    double power = 0;
+    for (size_t i = 0; i < 30; i++) {
+      power += block_powers[i];
+    }
+    power /= 30;
+    last.short_term = loudness_of(power);
+    if (last.short_term >= ABSOLUTE_GATE) {
+      short_terms.add(last.short_term, power);
+    }
+  }
+
+  // Integrated loudness: relative gate 10 LU below the absolute-gated mean.
+  uint64_t count = 0;
+  double power = 0;
+  for (size_t i = 0; i < HISTOGRAM_BINS; i++) {
+    count += gating_blocks.counts[i];
+    power += gating_blocks.powers[i];
+  }
+  if (count != 0) {
+    size_t gate = histogram_bin(loudness_of(power / count) - 10);
+    count = 0;
+    power = 0;
+    for (size_t i = gate; i < HISTOGRAM_BINS; i++) {
+      count += gating_blocks.counts[i];
+      power += gating_blocks.powers[i];
+    }
+    last.integrated = count != 0 ? loudness_of(power / count) : -INFINITY;
+  }
+
+  // Loudness range: 10th to 95th percentile of short-term loudness above a
+  // relative gate 20 LU below the absolute-gated mean.
+  count = 0;
+  power = 0;
+  for (size_t i = 0; i < HISTOGRAM_BINS; i++) {
+    count += short_terms.counts[i];
+    power += short_terms.powers[i];
+  }
+  if (count != 0) {
+    size_t gate = histogram_bin(loudness_of(power / count) - 20);
+    uint64_t gated = 0;
+    for (size_t i = gate; i < HISTOGRAM_BINS; i++) {
+      gated += short_terms.counts[i];
+    }
+    uint64_t seen = 0;
+    size_t low = HISTOGRAM_BINS, high = gate;
+    for (size_t i = gate; i < HISTOGRAM_BINS; i++) {
+      seen += short_terms.counts[i];
+      if (low == HISTOGRAM_BINS && seen * 10 > gated) {
+        low = i;
+      }
+      if (seen * 100 < gated * 95) {
+        high = i + 1;
+      }
+    }
+    high = std::max(std::min(high, HISTOGRAM_BINS - 1), low);
+    last.range = (high - low) * HISTOGRAM_STEP;
+  }
+}
+
+LoudnessReading LoudnessMeter::reading() const {
+  LoudnessReading result = last;
+  result.true_peak = peak > 0 ? 20 * log10(peak) : -INFINITY;
+  return result;
+}
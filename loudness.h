@@ -0,0 +1,74 @@
+#ifndef _AUDIO_VISUALIZER_LOUDNESS_H_
+#define _AUDIO_VISUALIZER_LOUDNESS_H_
+
+#include <SDL_audio.h>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct LoudnessReading {
+  double momentary = -INFINITY;  // LUFS, last 400 ms
+  double short_term = -INFINITY; // LUFS, last 3 s
+  double integrated = -INFINITY; // LUFS, gated, since reset()
+  double range = 0;              // LU, EBU Tech 3342 loudness range
+  double true_peak = -INFINITY;  // dBTP, max since reset()
+};
+
+// ITU-R BS.1770-4 / EBU R128 meter for one or two channels, fed with the same
+// blocks the audio callback plays. Work per sample is fixed (two K-weighting
+// biquads and a 4x oversampling FIR, both on L and R at once); gating keeps
+// 0.1 LU histograms, so nothing grows with playing time.
+class LoudnessMeter {
+public:
+  LoudnessMeter();
+
+  void reset(long rate, SDL_AudioFormat format, int channels);
+
+  // left and right hold raw sample values as produced by deinterleave().
+  void process(const double *left, const double *right, size_t n);
+
+  LoudnessReading reading() const;
+
+private:
+  struct Histogram {
+    std::vector<uint64_t> counts;
+    std::vector<double> powers;
+    void clear();
+    void add(double loudness, double power);
+  };
+
+  void finish_block();
+
+  double scale = 1;
+  double offset = 0;
+  double right_weight = 1; // 0 for mono input duplicated into both channels
+  size_t block_samples = 0; // 100 ms
+  size_t block_fill = 0;
+  double block_power = 0;
+
+  // K-weighting, two cascaded biquads in transposed direct form II.
+  double b[2][3], a[2][3];
+  double z[2][2][2]; // [stage][state][channel]
+
+  // Mean power of the last 30 100 ms blocks, ring buffer.
+  double block_powers[30];
+  size_t blocks_seen = 0;
+
+  Histogram gating_blocks; // 400 ms blocks for integrated loudness
+  Histogram short_terms;   // 3 s windows for loudness range
+
+  // Polyphase FIR for 4x oversampling, history[i][channel].
+  static const int TP_PHASES = 4;
+  static const int TP_TAPS = 12;
+  double fir[TP_PHASES][TP_TAPS];
+  // Doubled ring: sample i is stored at i and i + TP_TAPS, so the last
+  // TP_TAPS samples are always contiguous.
+  double history[2 * TP_TAPS][2];
+  int history_pos = 0;
+  double peak = 0;
+
+  LoudnessReading last;
+};
+
+#endif
@@ -1,45 +1,101 @@
 #include "SDL_events.h"
 #include "SDL_scancode.h"
+#include "batch.h"
+#include "beat.h"
+#include "channels.h"
 #include "converter.h"
 #include "fft.h"
+#include "filterbank.h"
+#include "frame_arena.h"
 #include "gl.h"
 #include "global.h"
 #include "imgui.h"
 #include "imgui_impl_opengl3.h"
 #include "imgui_impl_sdl.h"
+#include "loudness.h"
+#include "partials.h"
+#include "pitch.h"
+#include "playlist.h"
 #include "plot3d.h"
+#include "render_scheduler.h"
+#include "scrollback.h"
+#include "shader_utils.h"
 #include "spectrogram.h"
+#include "spectrum_store.h"
+#include "stream.h"
+#include "thread_pool.h"
 #include "tinyfiledialogs.h"
+#include "views.h"
+#include "waterfall.h"
 #include <SDL.h>
 #include <SDL_audio.h>
 #include <SDL_opengl.h>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstring>
 #include <deque>
 #include <exception>
+#include <fcntl.h>
+#include <filesystem>
 #include <fmt123.h>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <mutex>
-#include <numeric>
 #include <optional>
+#include <sstream>
 #include <stdexcept>
 #include <stdio.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
 #include <vector>
 
-#define V2D 0
-#define V3D 1
 
-const int TARGET_FPS = 50;
-const int HISTORY_SIZE = 5 * TARGET_FPS;
+#define SOURCE_LINEAR 0
+#define SOURCE_LOG 1
+#define SOURCE_MEL 2
+#define SOURCE_CHROMA 3
+
+const size_t LOG_BANDS = 256;
+const size_t MEL_BANDS = 64;
+// Neighbouring semitones only fall into separate 50 Hz bins from about A5
+// (880 Hz, 52 Hz apart) up; below that the chroma would be smeared across
+// pitch classes. Three octaves from there.
+const int CHROMA_FIRST_NOTE = 81;
+const int CHROMA_LAST_NOTE = 116;
 
 static SDL_Window *window;
 static SDL_GLContext gl_context;
 static ImGuiIO *io;
 
-static int selected_visualization = V2D;
+// Written by the main loop from the enabled views, read by the analysis.
+static std::atomic<unsigned> analysis_features{~0u};
+// What the last analysed block computed, under big_lock.
+static unsigned analysed_features = 0;
+static size_t spectrum_view;
+static int selected_source = SOURCE_LINEAR;
+static double analysis_ms = 0;
+static int selected_channel = CHANNEL_MID;
+static StereoStats stereo;
+static LoudnessMeter loudness;
+static BeatTracker beats(TARGET_FPS);
+// The tracker belongs to the analysis, which estimates on the pool without
+// big_lock. Everyone else asks for a reset at the next block through
+// pitch_reset and reads pitch_reading, guarded by big_lock.
+static PitchTracker pitch;
+static std::atomic<bool> pitch_reset{false};
+static PitchReading pitch_reading;
+static PartialTracker partials(HISTORY_SIZE);
+static double pitch_ms = 0;
+static SpectrumSmoothing smoothing;
+static bool spectrum_bars = false;
+static Uint64 start_counter;
+static double first_frame_ms = 0;
 
 static const char *audio_types[1] = {"*.mp3"};
-static char *audio_name = nullptr;
+static std::string audio_name;
 static bool audio_played = false;
 static bool done = false;
 static bool audio_finished = false;
@@ -47,6 +103,27 @@ static bool audio_finished = false;
 std::optional<PCM_data> audio_data;
 std::deque<std::vector<double>> plot_data;
 std::deque<std::vector<double>> plot_fft_input;
+// plot_data reduced to the selected data source (empty for SOURCE_LINEAR).
+std::deque<std::vector<double>> plot_features;
+std::map<std::pair<int, size_t>, Filterbank> filterbanks;
+// Identifies plot_data.front(), see plot3dDisplay().
+uint64_t plot_frame_id = 0;
+// Set while an SDL_USEREVENT waking up the main loop is in the queue.
+static std::atomic<bool> wakeup_pending{false};
+// Precomputed spectrogram of the current file (<name>.avs next to it), if any.
+std::unique_ptr<SpectrumStore> spectrum_store;
+// Every analysed spectrum, for scrubbing back further than plot_data goes.
+static Scrollback scrollback;
+// While frozen the views show HISTORY_SIZE frames of the scrollback ending
+// scrub_frames before frozen_end, and the analysis carries on behind them.
+static bool history_frozen = false;
+static uint64_t frozen_end = 0;
+static int scrub_frames = 0;
+static std::deque<std::vector<double>> scrub_history;
+// What scrub_history was built for, and its frame id.
+static uint64_t scrub_end = UINT64_MAX;
+static int scrub_source = SOURCE_LINEAR;
+static uint64_t scrub_id = 0;
 
 std::mutex big_lock;
 const Uint8 *keyboard_state;
@@ -56,82 +133,411 @@ void SDL_error_exit() {
   exit(1);
 }
 
-double fromBytes(uint8_t *bytes, SDL_AudioFormat format) {
-  switch (format) {
-  case AUDIO_S16:
-    return *(reinterpret_cast<int16_t *>(bytes));
-  case AUDIO_U16:
-    return *(reinterpret_cast<uint16_t *>(bytes));
-  case AUDIO_U8:
-    return *bytes;
-  case AUDIO_S8:
-    return *(reinterpret_cast<int8_t *>(bytes));
-  case AUDIO_S32:
-    return *(reinterpret_cast<int32_t *>(bytes));
-  default:
-    assert(false);
+std::vector<double> fft_samples(const uint8_t *bytes, size_t num_bytes,
+                                bool meters) {
+  // One deinterleaving pass feeds the stereo and loudness meters, then the
+  // selected channel signal is mixed out of it.
+  static std::vector<double> left, right;
+  size_t n = num_bytes / (sample_byte_size(audio_data.value().format) *
+                          audio_data.value().channels);
+  left.resize(n);
+  right.resize(n);
+  deinterleave(bytes, num_bytes, audio_data.value().format,
+               audio_data.value().channels, left.data(), right.data());
+
+  if (meters) {
+    loudness.process(left.data(), right.data(), n);
+
+    StereoStats stats = stereo_stats(left.data(), right.data(), n);
+    stereo.correlation = 0.9 * stereo.correlation + 0.1 * stats.correlation;
+    // Pure side signal has infinite width, cap it to keep the average usable.
+    stereo.width = 0.9 * stereo.width + 0.1 * std::min(stats.width, 10.0);
   }
+
+  std::vector<double> result(n);
+  mix_channels(selected_channel, left.data(), right.data(), n, result.data());
+  return result;
 }
 
-std::vector<double> fft_samples(int num_bytes) {
-  // We may have to merge samples of two channels and cast results to double.
+size_t frame_samples(const PCM_data &pcm) {
+  // One audio callback worth of samples, see start_audio().
+  size_t samples = pcm.rate / TARGET_FPS;
+  return samples - samples % pcm.channels;
+}
 
-  size_t sample_byte_size =
-      (SDL_AUDIO_MASK_BITSIZE & audio_data.value().format) / 8;
-  size_t num_samples =
-      num_bytes / (sample_byte_size * audio_data.value().channels);
+size_t frame_samples() { return frame_samples(audio_data.value()); }
 
-  std::vector<double> result(num_samples, 0);
+size_t frame_bytes() {
+  return frame_samples() * audio_data.value().channels *
+         sample_byte_size(audio_data.value().format);
+}
 
-  size_t processed = 0;
-  for (int i = 0; i < num_samples; i++) {
-    for (int ch = 0; ch < audio_data.value().channels; ch++) {
-      result[i] +=
-          (double)(fromBytes(audio_data.value().bytes.data() +
-                                 audio_data.value().processed_bytes + processed,
-                             audio_data.value().format));
-      processed += sample_byte_size;
+// in_track: the block starts at processed_bytes of the current track, rather
+// than joining two tracks.
+// The frame's spectrum from the store, empty when it has to be computed.
+// Must be called with big_lock held.
+std::vector<double> stored_spectrum(size_t num_bytes, bool in_track) {
+  // Stores hold the mono mixdown, which is what CHANNEL_MID shows.
+  if (spectrum_store != nullptr && selected_channel == CHANNEL_MID &&
+      in_track && num_bytes == frame_bytes()) {
+    size_t frame = audio_data.value().processed_bytes / num_bytes;
+    if (frame < spectrum_store->frames()) {
+      return spectrum_store->frame(frame);
     }
   }
-  assert(num_bytes == processed);
+  return std::vector<double>();
+}
 
-  return result;
+std::unique_ptr<SpectrumStore> load_spectrum_store(const char *audio_path,
+                                                   const PCM_data &pcm) {
+  std::filesystem::path store_path(audio_path);
+  store_path.replace_extension(".avs");
+  if (!std::filesystem::exists(store_path)) {
+    return nullptr;
+  }
+
+  try {
+    auto store = std::make_unique<SpectrumStore>(store_path.string());
+    if (store->sample_rate() != pcm.rate || store->frame_rate() != TARGET_FPS ||
+        store->bins() != frame_samples(pcm) / 2) {
+      std::cout << "Ignoring " << store_path
+                << ": it doesn't match the file's format" << std::endl;
+      return nullptr;
+    }
+    return store;
+  } catch (std::exception &e) {
+    std::cout << "Ignoring " << store_path << ": " << e.what() << std::endl;
+    return nullptr;
+  }
 }
 
-void audio_callback(void *udata, Uint8 *stream, int len) {
-  SDL_memset(stream, 0, len);
+void open_spectrum_store(const char *audio_path) {
+  spectrum_store = load_spectrum_store(audio_path, audio_data.value());
+}
 
-  size_t left_in_buffer =
-      audio_data.value().bytes.size() - audio_data.value().processed_bytes;
-  if (left_in_buffer == 0) {
-    audio_played = false;
+// Runs on the playlist's thread once the next track is decoded.
+void prepare_track(PlaylistTrack &track) {
+  track.store = load_spectrum_store(track.path.c_str(), track.pcm);
+  // Plans are cached, so the first callback of the track doesn't plan.
+  std::vector<double> frame(frame_samples(track.pcm));
+  amplitudes_of_harmonics(frame);
+}
+
+static Playlist playlist(prepare_track);
+// The track a gapless switch replaced; freed by the main loop rather than
+// in the audio callback. Only the callback fills it and only when it is
+// empty, only the main loop empties it.
+static std::atomic<PlaylistTrack *> retired_track{nullptr};
+
+// Live PCM from another process (--pcm, --shm), played instead of audio_data.
+std::unique_ptr<PcmRing> stream_ring;
+std::unique_ptr<FdReader> stream_reader;
+// A producer running a little fast would otherwise add latency without
+// bound: anything beyond this many callback blocks is dropped.
+const size_t STREAM_MAX_BLOCKS = 3;
+// Written by the audio callback, shown by the UI.
+static std::atomic<double> stream_latency_ms{0};
+static std::atomic<size_t> stream_dropped_bytes{0};
+static std::atomic<size_t> stream_underruns{0};
+
+const Filterbank &filterbank_for(int source, size_t bins) {
+  auto key = std::make_pair(source, bins);
+  auto it = filterbanks.find(key);
+  if (it != filterbanks.end()) {
+    return it->second;
+  }
+
+  double nyquist = bins * TARGET_FPS;
+  Filterbank fb;
+  switch (source) {
+  case SOURCE_LOG:
+    fb = log_filterbank(bins, TARGET_FPS, LOG_BANDS, TARGET_FPS, nyquist);
+    break;
+  case SOURCE_MEL:
+    fb = mel_filterbank(bins, TARGET_FPS, MEL_BANDS, 0, nyquist);
+    break;
+  case SOURCE_CHROMA:
+    fb = semitone_filterbank(bins, TARGET_FPS, CHROMA_FIRST_NOTE,
+                             CHROMA_LAST_NOTE);
+    break;
+  default:
+    throw std::logic_error("filterbank_for: not a filterbank source");
+  }
+  return filterbanks.emplace(key, std::move(fb)).first->second;
+}
+
+std::vector<double> features_of(const std::vector<double> &spectrum) {
+  const Filterbank &fb = filterbank_for(selected_source, spectrum.size());
+  std::vector<double> bands(fb.bands());
+  apply_filterbank(fb, spectrum.data(), bands.data());
+  if (selected_source != SOURCE_CHROMA) {
+    return bands;
+  }
+
+  std::vector<double> chroma(CHROMA_BINS);
+  fold_chroma(bands.data(), bands.size(), CHROMA_FIRST_NOTE, chroma.data());
+  return chroma;
+}
+
+void history_replaced() { plot_frame_id += HISTORY_SIZE + 1; }
+
+// Must be called with big_lock held.
+void rebuild_features() {
+  history_replaced();
+  plot_features.clear();
+  if (selected_source == SOURCE_LINEAR) {
     return;
   }
+  for (auto &spectrum : plot_data) {
+    plot_features.push_back(features_of(spectrum));
+  }
+}
+
+bool same_format(const PCM_data &a, const PCM_data &b) {
+  return a.rate == b.rate && a.format == b.format && a.channels == b.channels;
+}
+
+// Makes `track` the current one and returns it holding the previous one.
+// The visual history and the trackers carry on, only the per-track meters
+// start over.
+std::unique_ptr<PlaylistTrack>
+switch_track(std::unique_ptr<PlaylistTrack> track) {
+  std::lock_guard<std::mutex> guard(big_lock);
+  if (!audio_data.has_value()) {
+    audio_data = PCM_data();
+  }
+  std::swap(audio_data.value(), track->pcm);
+  std::swap(spectrum_store, track->store);
+  std::swap(audio_name, track->path);
+  loudness.reset(audio_data->rate, audio_data->format, audio_data->channels);
+  if (!same_format(audio_data.value(), track->pcm)) {
+    pitch_reset = true;
+  }
+  return track;
+}
 
-  int bytes_to_be_copied = len < left_in_buffer ? len : left_in_buffer;
+// Trackers that were off missed blocks, they start over when turned on.
+// Must be called with big_lock held.
+static void start_features(unsigned started) {
+  if (started & FEATURE_LOUDNESS) {
+    loudness.reset(audio_data->rate, audio_data->format, audio_data->channels);
+  }
+  if (started & FEATURE_BEATS) {
+    beats.reset();
+  }
+  if (started & FEATURE_PITCH) {
+    pitch_reset = true;
+  }
+  if (started & FEATURE_PARTIALS) {
+    partials.reset();
+  }
+}
 
+// Only the features some view or the UI asked for are computed.
+void analyze_block(const uint8_t *bytes, size_t num_bytes, bool in_track) {
+  unsigned features = analysis_features;
+  // Beats and partials work on the spectrum too.
+  const unsigned SPECTRAL =
+      FEATURE_SPECTRUM | FEATURE_BEATS | FEATURE_PARTIALS;
   big_lock.lock();
-  plot_fft_input.push_front(fft_samples(bytes_to_be_copied));
+  unsigned previous = analysed_features;
+  unsigned started = features & ~previous;
+  analysed_features = features;
+  start_features(started);
+  if ((previous & SPECTRAL) && !(features & SPECTRAL)) {
+    // The history would have a hole, drop it instead.
+    plot_data.clear();
+    plot_features.clear();
+    history_replaced();
+  }
+
+  std::vector<double> samples =
+      fft_samples(bytes, num_bytes, features & FEATURE_LOUDNESS);
+  std::vector<double> spectrum;
+  if (features & SPECTRAL) {
+    spectrum = stored_spectrum(num_bytes, in_track);
+  }
+  if (pitch_reset.exchange(false)) {
+    pitch.reset(audio_data->rate, audio_data->format);
+    pitch_reading = PitchReading();
+  }
   big_lock.unlock();
+
+  // The pitch doesn't depend on the spectrum: it runs on the pool while this
+  // thread does the FFT, and wait() runs it here when no worker got to it.
+  // Pool tasks never take big_lock (a thread waiting for the pool may hold
+  // it and run them), so the results are merged below.
+  TaskGroup analysis(shared_pool(), ThreadPool::PRIORITY_REALTIME);
+  PitchReading reading;
+  double ms = 0;
+  if (features & FEATURE_PITCH) {
+    analysis.run([&samples, &reading, &ms] {
+      Uint64 pitch_start = SDL_GetPerformanceCounter();
+      pitch.push(samples.data(), samples.size());
+      reading = pitch.estimate();
+      ms = 1000.0 * (SDL_GetPerformanceCounter() - pitch_start) /
+           SDL_GetPerformanceFrequency();
+    });
+  }
+  if ((features & SPECTRAL) && spectrum.empty()) {
+    spectrum = amplitudes_of_harmonics(samples);
+  }
+  analysis.wait();
+
+  big_lock.lock();
+  if ((features & FEATURE_PITCH) && !pitch_reset) {
+    pitch_reading = reading;
+    pitch_ms = 0.9 * pitch_ms + 0.1 * ms;
+  }
+  plot_fft_input.push_front(std::move(samples));
   if (plot_fft_input.size() > HISTORY_SIZE) {
-    big_lock.lock();
     plot_fft_input.resize(HISTORY_SIZE);
-    big_lock.unlock();
   }
-  big_lock.lock();
-  plot_data.push_front(amplitudes_of_harmonics(plot_fft_input.front()));
-  big_lock.unlock();
-  if (plot_data.size() > HISTORY_SIZE) {
-    big_lock.lock();
-    plot_data.resize(HISTORY_SIZE);
+  if (!(features & SPECTRAL)) {
+    plot_frame_id++;
     big_lock.unlock();
+  } else {
+    if (!(previous & SPECTRAL)) {
+      history_replaced();
+    }
+    plot_data.push_front(std::move(spectrum));
+    scrollback.push(plot_data.front(), frame_samples() / 2);
+    plot_frame_id++;
+    if (features & FEATURE_BEATS) {
+      beats.process(plot_data.front().data(), plot_data.front().size());
+    }
+    if (features & FEATURE_PARTIALS) {
+      partials.process(plot_data.front().data(), plot_data.front().size(),
+                       TARGET_FPS);
+    }
+    if (started & FEATURE_SPECTRUM) {
+      // Bands weren't kept up while nothing showed them.
+      rebuild_features();
+    } else if ((features & FEATURE_SPECTRUM) &&
+               selected_source != SOURCE_LINEAR) {
+      Uint64 start = SDL_GetPerformanceCounter();
+      plot_features.push_front(features_of(plot_data.front()));
+      double ms = 1000.0 * (SDL_GetPerformanceCounter() - start) /
+                  SDL_GetPerformanceFrequency();
+      analysis_ms = 0.9 * analysis_ms + 0.1 * ms;
+    }
+    big_lock.unlock();
+    if (plot_data.size() > HISTORY_SIZE) {
+      big_lock.lock();
+      plot_data.resize(HISTORY_SIZE);
+      if (plot_features.size() > HISTORY_SIZE) {
+        plot_features.resize(HISTORY_SIZE);
+      }
+      big_lock.unlock();
+    }
   }
 
-  SDL_MixAudio(stream,
-               audio_data.value().bytes.data() +
-                   audio_data.value().processed_bytes,
-               bytes_to_be_copied, SDL_MIX_MAXVOLUME);
-  audio_data.value().processed_bytes += bytes_to_be_copied;
+  // Wakes up the main loop to draw the new frame.
+  if (!wakeup_pending.exchange(true)) {
+    SDL_Event event = {};
+    event.type = SDL_USEREVENT;
+    SDL_PushEvent(&event);
+  }
+}
+
+void stream_callback(Uint8 *stream, size_t len) {
+  PcmRing &ring = *stream_ring;
+  size_t frame = ring.frame_bytes();
+  size_t backlog = ring.buffered();
+  if (backlog > STREAM_MAX_BLOCKS * len) {
+    size_t drop = backlog - len;
+    drop -= drop % frame;
+    ring.release(drop);
+    stream_dropped_bytes += drop;
+  }
+
+  // End to end: the newest byte in the ring was committed producer_age_ms
+  // ago and everything buffered in front of this block (the pipe, the ring)
+  // plays before it, then the block sits in the device buffer.
+  double ms_per_byte = 1000 / ring.bytes_per_second();
+  size_t queued = ring.buffered() +
+                  (stream_reader != nullptr ? stream_reader->pending() : 0);
+  double latency =
+      ring.producer_age_ms() + (queued + len) * ms_per_byte;
+  stream_latency_ms = 0.9 * stream_latency_ms + 0.1 * latency;
+
+  // The block is analysed and played straight from the ring when it is
+  // contiguous there, shared memory included.
+  size_t contiguous;
+  const uint8_t *block = ring.readable(contiguous);
+  bool in_place = contiguous >= len;
+  if (!in_place) {
+    static std::vector<uint8_t> gathered;
+    gathered.assign(len, 0);
+    size_t got = ring.read(gathered.data(), len);
+    if (got == 0 && ring.closed()) {
+      audio_finished = true;
+      return;
+    }
+    // Short reads are padded with the silence that plays anyway.
+    if (got < len) {
+      stream_underruns++;
+    }
+    block = gathered.data();
+  }
+
+  analyze_block(block, len, false);
+  SDL_MixAudio(stream, block, len, SDL_MIX_MAXVOLUME);
+  if (in_place) {
+    ring.release(len);
+  }
+}
+
+void audio_callback(void *udata, Uint8 *stream, int len) {
+  SDL_memset(stream, 0, len);
+
+  if (stream_ring != nullptr) {
+    stream_callback(stream, len);
+    return;
+  }
+
+  size_t left_in_buffer =
+      audio_data.value().bytes.size() - audio_data.value().processed_bytes;
+
+  // When the track ends within this block and the next one is decoded in
+  // the same format, its first bytes follow the last bytes of this one in
+  // the same block: the switch is sample-accurate and without a gap.
+  std::unique_ptr<PlaylistTrack> next;
+  if (left_in_buffer <= (size_t)len && retired_track == nullptr) {
+    next = playlist.take([](const PlaylistTrack &track) {
+      return same_format(track.pcm, audio_data.value());
+    });
+  }
+
+  // Silence until the main loop stops the device or starts the next track.
+  if (left_in_buffer == 0 && next == nullptr) {
+    return;
+  }
+
+  const uint8_t *block =
+      audio_data.value().bytes.data() + audio_data.value().processed_bytes;
+  size_t block_bytes = std::min((size_t)len, left_in_buffer);
+  size_t next_bytes = 0;
+  if (next != nullptr) {
+    static std::vector<uint8_t> joined;
+    next_bytes = std::min(len - left_in_buffer, next->pcm.bytes.size());
+    joined.resize(len);
+    std::copy(block, block + left_in_buffer, joined.begin());
+    std::copy(next->pcm.bytes.begin(), next->pcm.bytes.begin() + next_bytes,
+              joined.begin() + left_in_buffer);
+    block = joined.data();
+    block_bytes = left_in_buffer + next_bytes;
+  }
+
+  analyze_block(block, block_bytes, next == nullptr);
+  SDL_MixAudio(stream, block, block_bytes, SDL_MIX_MAXVOLUME);
+
+  if (next != nullptr) {
+    next->pcm.processed_bytes = next_bytes;
+    retired_track = switch_track(std::move(next)).release();
+  } else {
+    audio_data.value().processed_bytes += block_bytes;
+  }
 
   if (audio_data.value().processed_bytes == audio_data.value().bytes.size()) {
     audio_finished = true;
@@ -139,7 +545,7 @@ void audio_callback(void *udata, Uint8 *stream, int len) {
 }
 
 void start_audio() {
-  if (audio_played || !audio_data.has_value() || audio_name == nullptr) {
+  if (audio_played || !audio_data.has_value() || audio_name.empty()) {
     return;
   }
 
@@ -185,25 +591,184 @@ void stop_audio() {
   audio_played = false;
 }
 
-void select_file() {
+void close_stream() {
+  stream_reader.reset();
+  stream_ring.reset();
+}
+
+// Plays the PCM of ring (and of the fd behind it) like a loaded file.
+void open_stream(std::unique_ptr<PcmRing> ring, int fd, const char *name) {
   stop_audio();
-  audio_name = nullptr;
-  char *new_audio_name = tinyfd_openFileDialog(
-      "Pick file", nullptr, 1, audio_types, "All supported files", false);
+  close_stream();
+  plot_data.clear();
+  plot_features.clear();
+  history_replaced();
+  plot_fft_input.clear();
+
+  PCM_data pcm;
+  pcm.format = ring->format();
+  pcm.channels = ring->channels();
+  pcm.rate = ring->rate();
+  pcm.processed_bytes = 0;
+  audio_data = std::move(pcm);
+  audio_name = name;
+  spectrum_store.reset();
+  audio_finished = false;
+  stream_dropped_bytes = 0;
+  stream_underruns = 0;
+  loudness.reset(audio_data->rate, audio_data->format, audio_data->channels);
+  beats.reset();
+  pitch_reset = true;
+  partials.reset();
+
+  stream_ring = std::move(ring);
+  if (fd >= 0) {
+    stream_reader = std::make_unique<FdReader>(fd, *stream_ring);
+  }
+  start_audio();
+}
+
+// File dialogs block until they are closed, so they run on their own thread
+// and the main loop picks up the selection in poll_dialog(). The thread only
+// writes to its DialogResult, which it shares: it may outlive main() when a
+// dialog is still open at exit.
+enum DialogKind { DIALOG_OPEN, DIALOG_ENQUEUE };
+struct DialogResult {
+  DialogKind kind;
+  std::string selection;
+  std::atomic<bool> done{false};
+};
+static std::thread dialog_thread;
+static std::shared_ptr<DialogResult> dialog;
+// A file picked with "Select file": it replaces the current track as soon
+// as it is decoded, until then the current one keeps playing.
+static std::string pending_open;
 
-  if (new_audio_name == nullptr) {
+void show_dialog(DialogKind kind) {
+  if (dialog_thread.joinable()) {
     return;
   }
+  dialog = std::make_shared<DialogResult>();
+  dialog->kind = kind;
+  dialog_thread = std::thread([result = dialog] {
+    const char *selection =
+        result->kind == DIALOG_OPEN
+            ? tinyfd_openFileDialog("Pick file", nullptr, 1, audio_types,
+                                    "All supported files", false)
+            : tinyfd_openFileDialog("Add to playlist", nullptr, 1,
+                                    audio_types, "All supported files", true);
+    result->selection = selection != nullptr ? selection : "";
+    result->done = true;
+  });
+}
 
-  plot_data.clear();
-  plot_fft_input.clear();
+void open_file(const std::string &path) {
+  playlist.add_front(path);
+  pending_open = path;
+}
 
-  try {
-    audio_data = std::optional(from_mp3(new_audio_name));
-    audio_name = new_audio_name;
-  } catch (...) {
-    std::cout << "Error reading or opening file " << new_audio_name
-              << std::endl;
+void poll_dialog() {
+  if (!dialog || !dialog->done) {
+    return;
+  }
+  dialog_thread.join();
+  std::shared_ptr<DialogResult> result = std::move(dialog);
+  if (result->selection.empty()) {
+    return;
+  }
+  if (result->kind == DIALOG_OPEN) {
+    open_file(result->selection);
+    return;
+  }
+  // Multiple selections come back separated by '|'.
+  std::stringstream paths(result->selection);
+  std::string path;
+  while (std::getline(paths, path, '|')) {
+    if (!path.empty()) {
+      playlist.add(path);
+    }
+  }
+}
+
+void select_file() { show_dialog(DIALOG_OPEN); }
+
+void enqueue_files() { show_dialog(DIALOG_ENQUEUE); }
+
+// Called every frame from the main loop.
+void advance_playlist() {
+  poll_dialog();
+  playlist.update();
+  delete retired_track.exchange(nullptr);
+
+  if (!pending_open.empty()) {
+    big_lock.lock();
+    bool playing = audio_name == pending_open;
+    big_lock.unlock();
+    if (playing || (playlist.next_ready() &&
+                    playlist.next_path() != pending_open)) {
+      // Taken by the callback at the end of the track, or it failed.
+      pending_open.clear();
+    } else if (playlist.next_ready()) {
+      pending_open.clear();
+      // Stopped first: until then the callback may take it at the end of
+      // the current track.
+      stop_audio();
+      std::unique_ptr<PlaylistTrack> track = playlist.take();
+      if (track == nullptr) {
+        start_audio();
+        return;
+      }
+      close_stream();
+      switch_track(std::move(track));
+      plot_data.clear();
+      plot_features.clear();
+      history_replaced();
+      plot_fft_input.clear();
+      beats.reset();
+      pitch_reset = true;
+      partials.reset();
+      audio_finished = false;
+      start_audio();
+      return;
+    }
+  }
+
+  // The callback swaps both in switch_track().
+  big_lock.lock();
+  bool idle = !audio_data.has_value() || audio_name.empty();
+  big_lock.unlock();
+  if (!idle && !audio_finished) {
+    return;
+  }
+  if (audio_finished) {
+    // Stopped, the callback can't switch tracks behind our back.
+    stop_audio();
+    close_stream();
+    if (audio_data->processed_bytes < audio_data->bytes.size()) {
+      // It already did, after the track had run out.
+      audio_finished = false;
+      start_audio();
+      return;
+    }
+  }
+
+  if (playlist.next_ready()) {
+    // Nothing playing, or the next track has another format: the device
+    // has to be reopened, which can't be gapless.
+    std::unique_ptr<PlaylistTrack> track = playlist.take();
+    if (track != nullptr) {
+      switch_track(std::move(track));
+      audio_finished = false;
+      start_audio();
+    }
+  } else if (audio_finished && playlist.empty()) {
+    audio_name.clear();
+    spectrum_store.reset();
+    audio_finished = false;
+    plot_data.clear();
+    plot_features.clear();
+    history_replaced();
+    plot_fft_input.clear();
   }
 }
 
@@ -253,8 +818,6 @@ void set_up() {
   ImGui_ImplOpenGL3_Init(glsl_version);
 
   keyboard_state = SDL_GetKeyboardState(nullptr);
-  spectrogramInit();
-  plot3dInit();
 }
 
 void clean_up() {
@@ -267,21 +830,174 @@ void clean_up() {
   SDL_Quit();
 }
 
+void refill_history_from_store() {
+  // After a seek the live history no longer matches the playback position,
+  // rebuild it from the precomputed frames preceding the new position.
+  if (spectrum_store == nullptr) {
+    return;
+  }
+  size_t frame = audio_data->processed_bytes / frame_bytes();
+  frame = std::min(frame, spectrum_store->frames());
+
+  std::lock_guard<std::mutex> guard(big_lock);
+  plot_data.clear();
+  for (size_t i = 1; i <= frame && plot_data.size() < HISTORY_SIZE; i++) {
+    plot_data.push_back(spectrum_store->frame(frame - i));
+  }
+  rebuild_features();
+}
+
 void set_audio_position(int seconds) {
   bool audio_played_at_start = audio_played;
 
   if (audio_played_at_start) {
     stop_audio();
   }
-  audio_data->processed_bytes =
-      seconds * audio_data->rate * audio_data->channels * 2;
+  audio_data->processed_bytes = seconds * audio_data->rate *
+                                audio_data->channels *
+                                sample_byte_size(audio_data->format);
+  beats.reset();
+  pitch_reset = true;
+  partials.reset();
+  refill_history_from_store();
 
   if (audio_played_at_start) {
     start_audio();
   }
 }
 
-void imgui_frame() {
+// Overlays are drawn over the spectrum view in `rect`.
+void pitch_overlay(const ViewRect &rect) {
+  const double MIN_CONFIDENCE = 0.8;
+  big_lock.lock();
+  PitchReading reading = pitch_reading;
+  size_t bins = plot_data.empty() ? 0 : plot_data.front().size();
+  big_lock.unlock();
+
+  ImDrawList *draw_list = ImGui::GetForegroundDrawList();
+  char text[64];
+  if (reading.frequency > 0 && reading.confidence >= MIN_CONFIDENCE) {
+    snprintf(text, sizeof(text), "%.1f Hz  %s  (%.2f)", reading.frequency,
+             note_name(reading.frequency).c_str(), reading.confidence);
+  } else {
+    snprintf(text, sizeof(text), "no pitch");
+  }
+  draw_list->AddText(ImVec2(rect.x + rect.w - 260, rect.y + 20),
+                     IM_COL32(255, 255, 255, 255), text);
+
+  // Mark f0 on the linear spectrum, laid out like fftGraph().
+  if (selected_source == SOURCE_LINEAR && bins > 1 && reading.frequency > 0 &&
+      reading.confidence >= MIN_CONFIDENCE) {
+    float x = rect.w * reading.frequency / ((bins - 1) * TARGET_FPS);
+    if (x < rect.w) {
+      draw_list->AddLine(ImVec2(rect.x + x, rect.y),
+                         ImVec2(rect.x + x, rect.y + rect.h),
+                         IM_COL32(255, 255, 255, 96), 1.5f);
+    }
+  }
+}
+
+void partial_markers(const ViewRect &rect) {
+  const size_t MAX_LABELS = 8;
+  big_lock.lock();
+  Partial newest[MAX_TRACKS];
+  size_t bins = plot_data.empty() ? 0 : plot_data.front().size();
+  size_t count = 0;
+  if (partials.rows() != 0) {
+    const Partial *row = partials.row(0);
+    for (size_t s = 0; s < MAX_TRACKS; s++) {
+      if (row[s].id != 0) {
+        newest[count++] = row[s];
+      }
+    }
+  }
+  big_lock.unlock();
+  if (bins < 2) {
+    return;
+  }
+
+  std::sort(newest, newest + count, [](const Partial &a, const Partial &b) {
+    return a.magnitude > b.magnitude;
+  });
+  ImDrawList *draw_list = ImGui::GetForegroundDrawList();
+  for (size_t i = 0; i < count; i++) {
+    // Same layout as fftGraph(): x spans the bins, y is the upper half of
+    // clip space scaled by MAX_FFT_OUTPUT.
+    float x =
+        rect.x + rect.w * newest[i].frequency / ((bins - 1) * TARGET_FPS);
+    float y = rect.y + rect.h * (1 - newest[i].magnitude / MAX_FFT_OUTPUT);
+    draw_list->AddCircleFilled(ImVec2(x, y), 3, IM_COL32(255, 200, 0, 255));
+    if (i < MAX_LABELS) {
+      char label[16];
+      snprintf(label, sizeof(label), "%.0f", newest[i].frequency);
+      draw_list->AddText(ImVec2(x + 4, y - 16), IM_COL32(255, 200, 0, 255),
+                         label);
+    }
+  }
+}
+
+// The lighter compressor that is compiled in, STORE_RAW without any.
+uint32_t scrollback_compression() {
+  for (uint32_t compression : {STORE_LZ4, STORE_ZSTD}) {
+    if (store_compression_supported(compression)) {
+      return compression;
+    }
+  }
+  return STORE_RAW;
+}
+
+void history_controls() {
+  big_lock.lock();
+  uint64_t first = scrollback.first(), end = scrollback.end();
+  size_t memory = scrollback.memory();
+  ScrollbackOptions options = scrollback.get_options();
+  big_lock.unlock();
+  ImGui::Text("%.0f s of scrollback in %.1f MB",
+              (double)(end - first) / TARGET_FPS, memory / 1e6);
+
+  if (ImGui::Checkbox("Freeze", &history_frozen)) {
+    std::lock_guard<std::mutex> guard(big_lock);
+    if (history_frozen) {
+      frozen_end = end;
+      scrub_frames = 0;
+      scrub_end = UINT64_MAX;
+    } else {
+      // Back to the live history, every view starts over from it.
+      history_replaced();
+    }
+  }
+  if (history_frozen) {
+    ImGui::SameLine();
+    float back = (float)scrub_frames / TARGET_FPS;
+    float kept =
+        (float)(frozen_end - std::min(first, frozen_end)) / TARGET_FPS;
+    if (ImGui::SliderFloat("Scrub", &back, 0, kept, "-%.2f s")) {
+      scrub_frames = std::lround(back * TARGET_FPS);
+    }
+  }
+
+  int budget_mb = options.budget_bytes >> 20;
+  int sample_bits = options.sample_bits;
+  bool compressed = options.compression != STORE_RAW;
+  bool changed = ImGui::SliderInt("Memory budget", &budget_mb, 4, 1024,
+                                  "%d MB");
+  changed |= ImGui::RadioButton("8 bit", &sample_bits, 8);
+  ImGui::SameLine();
+  changed |= ImGui::RadioButton("16 bit", &sample_bits, 16);
+  if (scrollback_compression() != STORE_RAW) {
+    ImGui::SameLine();
+    changed |= ImGui::Checkbox("Compress older blocks", &compressed);
+  }
+  if (changed) {
+    options.budget_bytes = (size_t)budget_mb << 20;
+    options.sample_bits = sample_bits;
+    options.compression = compressed ? scrollback_compression() : STORE_RAW;
+    std::lock_guard<std::mutex> guard(big_lock);
+    scrollback.set_options(options);
+  }
+}
+
+void imgui_frame(const AnalysisFrame &frame) {
   // Start the Dear ImGui frame
   ImGui_ImplOpenGL3_NewFrame();
   ImGui_ImplSDL2_NewFrame();
@@ -294,7 +1010,31 @@ void imgui_frame() {
       select_file();
     }
     ImGui::SameLine();
-    ImGui::Text("Currently played file = %s", audio_name);
+    big_lock.lock();
+    std::string name = audio_name;
+    big_lock.unlock();
+    ImGui::Text("Currently played file = %s", name.c_str());
+
+    if (ImGui::Button("Enqueue files")) {
+      enqueue_files();
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("Repeat", &playlist.repeat);
+    ImGui::SameLine();
+    if (playlist.preparing()) {
+      double progress = playlist.progress();
+      std::string label = progress < 0 ? "decoding" : "";
+      ImGui::ProgressBar(progress < 0 ? 0 : progress, ImVec2(200, 0),
+                         label.empty() ? nullptr : label.c_str());
+      ImGui::SameLine();
+      ImGui::Text("%s, %zu more queued", playlist.next_path().c_str(),
+                  playlist.queued().size());
+    } else if (playlist.next_ready()) {
+      ImGui::Text("Up next: %s (ready), %zu more queued",
+                  playlist.next_path().c_str(), playlist.queued().size());
+    } else {
+      ImGui::Text("Playlist: %zu queued", playlist.queued().size());
+    }
 
     if (ImGui::Button("Play/Pause")) {
       toggle_playback();
@@ -302,12 +1042,94 @@ void imgui_frame() {
     ImGui::SameLine();
     ImGui::Text("Playback status: %s", audio_played ? "PLAY" : "PAUSE");
 
-    ImGui::RadioButton("2D", &selected_visualization, V2D);
-    ImGui::SameLine();
-    ImGui::RadioButton("3D", &selected_visualization, V3D);
+    std::vector<RegisteredView> &views = registered_views();
+    for (size_t v = 0; v < views.size(); v++) {
+      if (v != 0) {
+        ImGui::SameLine();
+      }
+      ImGui::Checkbox(views[v].plugin.name, &views[v].enabled);
+    }
+    if (views[spectrum_view].enabled) {
+      ImGui::SameLine();
+      ImGui::Checkbox("Bars", &spectrum_bars);
+      ImGui::SameLine();
+      ImGui::Checkbox("Smoothing", &smoothing.enabled);
+      if (smoothing.enabled) {
+        ImGui::SliderFloat("Attack", &smoothing.attack_ms, 0, 200, "%.0f ms");
+        ImGui::SliderFloat("Release", &smoothing.release_ms, 0, 2000,
+                           "%.0f ms");
+        ImGui::SliderFloat("Peak hold", &smoothing.hold_ms, 0, 3000,
+                           "%.0f ms");
+      }
+    }
 
+    int source = selected_source;
+    ImGui::RadioButton("Linear", &source, SOURCE_LINEAR);
+    ImGui::SameLine();
+    ImGui::RadioButton("Log", &source, SOURCE_LOG);
+    ImGui::SameLine();
+    ImGui::RadioButton("Mel", &source, SOURCE_MEL);
+    ImGui::SameLine();
+    ImGui::RadioButton("Chroma", &source, SOURCE_CHROMA);
+    ImGui::RadioButton("Mid", &selected_channel, CHANNEL_MID);
+    ImGui::SameLine();
+    ImGui::RadioButton("Side", &selected_channel, CHANNEL_SIDE);
+    ImGui::SameLine();
+    ImGui::RadioButton("Left", &selected_channel, CHANNEL_LEFT);
+    ImGui::SameLine();
+    ImGui::RadioButton("Right", &selected_channel, CHANNEL_RIGHT);
+    // The integrated loudness, its range and the true peak cover the whole
+    // track, so the loudness meter runs even while the meters are collapsed.
+    // The tempo is only tracked while they are open.
     if (audio_data.has_value()) {
+      add_ui_features(FEATURE_LOUDNESS);
+    }
+    if (ImGui::CollapsingHeader("Meters", ImGuiTreeNodeFlags_DefaultOpen) &&
+        audio_data.has_value()) {
+      add_ui_features(FEATURE_BEATS);
+      if (audio_data->channels == 2) {
+        ImGui::Text("Stereo correlation: %+.2f  width: %.2f",
+                    stereo.correlation, stereo.width);
+      }
+
+      big_lock.lock();
+      LoudnessReading lufs = loudness.reading();
+      big_lock.unlock();
+      ImGui::Text("Loudness M %.1f  S %.1f  I %.1f LUFS  LRA %.1f LU  "
+                  "TP %.1f dBTP",
+                  lufs.momentary, lufs.short_term, lufs.integrated,
+                  lufs.range, lufs.true_peak);
+
+      big_lock.lock();
+      BeatState beat = beats.state();
+      big_lock.unlock();
+      if (beat.bpm > 0) {
+        ImGui::Text("Tempo: %.1f BPM  confidence: %.2f  %s", beat.bpm,
+                    beat.confidence, beat.phase < 0.25 ? "*" : "");
+      } else {
+        ImGui::Text("Tempo: listening...");
+      }
+    }
+
+    if (ImGui::CollapsingHeader("History")) {
+      history_controls();
+    }
+
+    if (source != selected_source) {
+      std::lock_guard<std::mutex> guard(big_lock);
+      selected_source = source;
+      analysis_ms = 0;
+      rebuild_features();
+    }
+
+    if (stream_ring != nullptr) {
+      ImGui::Text("Stream latency: %.1f ms, %zu KiB dropped, %zu underruns",
+                  stream_latency_ms.load(), stream_dropped_bytes / 1024,
+                  stream_underruns.load());
+    } else if (audio_data.has_value()) {
       char label[12];
+      // The audio callback swaps tracks under big_lock.
+      big_lock.lock();
       int sample_byte_size =
           ((SDL_AUDIO_MASK_BITSIZE & audio_data.value().format) / 8);
 
@@ -317,6 +1139,7 @@ void imgui_frame() {
       int seconds_all = audio_data->bytes.size() /
                         (audio_data->rate * audio_data->channels) /
                         sample_byte_size;
+      big_lock.unlock();
       sprintf(label, "%02d:%02d/%02d:%02d", seconds_now / 60, seconds_now % 60,
               seconds_all / 60, seconds_all % 60);
       int seconds_slider = seconds_now;
@@ -325,58 +1148,312 @@ void imgui_frame() {
       }
     }
     ImGui::Text("Average FPS: %.1f", ImGui::GetIO().Framerate);
+    ImGui::Text("Frame arena: %zu KiB high-water, %zu KiB reserved",
+                frame_arena.high_water() / 1024, frame_arena.capacity() / 1024);
+    if (selected_source != SOURCE_LINEAR) {
+      ImGui::Text("Feature analysis: %.3f ms/frame", analysis_ms);
+    }
+    ImGui::Text("Pitch analysis: %.3f ms/update", pitch_ms);
+    const ProgramCacheStats &programs = program_cache_stats();
+    ImGui::Text("First frame: %.1f ms (shaders %.1f ms, %d/%d cached)",
+                first_frame_ms, programs.ms, programs.from_cache,
+                programs.programs);
+    for (const RegisteredView &view : registered_views()) {
+      if (!view.enabled) {
+        continue;
+      }
+      if (view.timer.gpu_ms() >= 0) {
+        ImGui::Text("%s view: %.3f ms CPU, %.3f ms GPU", view.plugin.name,
+                    view.timer.cpu_ms(), view.timer.gpu_ms());
+      } else {
+        ImGui::Text("%s view: %.3f ms CPU", view.plugin.name,
+                    view.timer.cpu_ms());
+      }
+    }
     ImGui::End();
   }
+
+  draw_view_overlays(frame, io->DisplaySize.x, io->DisplaySize.y);
   ImGui::Render();
 }
 
-void draw_visualization() {
-  if (plot_data.size() != 0) {
-    size_t fftN = 0;
+// Gathers what the views draw, once per frame, into the frame arena.
+// Rebuilds scrub_history when the scrub position or the source changed.
+// Must be called with big_lock held.
+void update_scrub_history() {
+  uint64_t end = frozen_end - std::min<uint64_t>(scrub_frames, frozen_end);
+  end = std::clamp(end, std::min(scrollback.first() + 1, scrollback.end()),
+                   scrollback.end());
+  if (end == scrub_end && selected_source == scrub_source) {
+    return;
+  }
+  scrub_end = end;
+  scrub_source = selected_source;
+  scrub_history.clear();
+  std::vector<double> spectrum(scrollback.bins());
+  for (uint64_t frame = end;
+       frame > scrollback.first() && scrub_history.size() < HISTORY_SIZE;
+       frame--) {
+    scrollback.read_frame(frame - 1, spectrum.data());
+    scrub_history.push_back(selected_source == SOURCE_LINEAR
+                                ? spectrum
+                                : features_of(spectrum));
+  }
+  history_replaced();
+  scrub_id = plot_frame_id;
+}
+
+AnalysisFrame publish_frame() {
+  std::lock_guard<std::mutex> guard(big_lock);
+  AnalysisFrame frame;
+  std::deque<std::vector<double>> *history =
+      selected_source == SOURCE_LINEAR ? &plot_data : &plot_features;
+  if (!audio_data.has_value()) {
+    return frame;
+  }
+  frame.id = plot_frame_id;
+  if (history_frozen) {
+    update_scrub_history();
+    history = &scrub_history;
+    frame.id = scrub_id;
+    frame.live = false;
+  }
+  const std::deque<std::vector<double>> &spectra = *history;
+  frame.history = history;
+  frame.format = audio_data->format;
+  frame.beat_pulse = frame.live ? beats.pulse() : 0;
+
+  for (auto &data : spectra) {
+    frame.bins = std::max(frame.bins, data.size());
+  }
+  // Features aren't linear in frequency, they are drawn evenly by index.
+  frame.label_step = selected_source == SOURCE_LINEAR ? TARGET_FPS : 1;
+  double *labels = frame_arena.alloc<double>(frame.bins);
+  for (size_t i = 0; i < frame.bins; i++) {
+    labels[i] = i * frame.label_step;
+  }
+  frame.labels = labels;
+  if (frame.bins != 0) {
+    // The newest spectrum can be shorter than the history's longest one.
+    float *spectrum = frame_arena.alloc<float>(frame.bins);
+    const std::vector<double> &newest = spectra.front();
+    std::copy(newest.begin(), newest.end(), spectrum);
+    std::fill(spectrum + newest.size(), spectrum + frame.bins, 0);
+    frame.spectrum = spectrum;
+  }
+
+  if (frame.live && !plot_fft_input.empty()) {
+    const std::vector<double> &wave = plot_fft_input.front();
+    frame.wave_n = wave.size();
+    float *samples = frame_arena.alloc<float>(frame.wave_n);
+    std::copy(wave.begin(), wave.end(), samples);
+    frame.wave = samples;
+  }
+  return frame;
+}
+
+void display_spectrum(const AnalysisFrame &frame) {
+  if (frame.bins != 0) {
+    spectrogramDisplaySpectrum(frame.spectrum, frame.bins, frame.id,
+                               smoothing, spectrum_bars);
+  }
+}
+
+void spectrum_overlay(const AnalysisFrame &frame, const ViewRect &rect) {
+  if (frame.bins == 0 || !frame.live) {
+    return;
+  }
+  pitch_overlay(rect);
+  if (selected_source == SOURCE_LINEAR) {
+    partial_markers(rect);
+  }
+}
+
+void display_waveform(const AnalysisFrame &frame) {
+  if (frame.wave_n != 0) {
+    spectrogramDisplayWave(frame.wave, frame.wave_n, frame.format);
+  }
+}
+
+void display_3d(const AnalysisFrame &frame) {
+  if (frame.bins == 0) {
+    return;
+  }
+  // A live history may have grown since the frame was published, its front
+  // is plot_frame_id now.
+  big_lock.lock();
+  plot3dDisplay(frame.labels, frame.bins, *frame.history,
+                frame.live ? plot_frame_id : frame.id, HISTORY_SIZE,
+                frame.format, frame.beat_pulse);
+  if (frame.live && selected_source == SOURCE_LINEAR) {
     big_lock.lock();
-    for (auto &data : plot_data) {
-      fftN = std::max(fftN, data.size());
-    }
-    big_lock.unlock();
-    std::vector<double> fftLabels(fftN);
-    for (size_t i = 0; i < fftN; i++) {
-      fftLabels[i] = i * TARGET_FPS;
-    }
+    plot3dDisplayRidges(partials, (frame.bins - 1) * frame.label_step);
+  }
+}
 
-    if (selected_visualization == V2D) {
-      big_lock.lock();
-      size_t waveN = plot_fft_input.front().size();
-      std::vector<double> waveLabels(waveN);
-      std::iota(waveLabels.begin(), waveLabels.end(), 0);
-      spectrogramDisplay(fftLabels.data(), plot_data.front().data(), fftN,
-                         waveLabels.data(), plot_fft_input.front().data(),
-                         waveN, audio_data.value().format);
-    } else if (selected_visualization == V3D) {
-      big_lock.lock();
-      plot3dDisplay(fftLabels, plot_data, audio_data.value().format);
-    }
+// The waterfall draws from the scrollback, so that frames that were never
+// drawn (a hidden window) still get their rows. It stands still while the
+// history is frozen.
+static uint64_t waterfall_end = 0;
+static int waterfall_source = SOURCE_LINEAR;
+
+void display_waterfall(const AnalysisFrame &frame) {
+  if (frame.bins == 0) {
+    return;
+  }
+  big_lock.lock();
+  if (selected_source != waterfall_source) {
+    waterfall_source = selected_source;
+    waterfallReset();
   }
+  if (frame.live) {
+    waterfall_end = scrollback.end();
+  }
+  std::vector<double> spectrum(scrollback.bins());
+  waterfallDisplay(
+      frame.bins, waterfall_end, [&](uint64_t n, double *out) {
+        if (n < scrollback.first() || n >= scrollback.end()) {
+          return false;
+        }
+        scrollback.read_frame(n, spectrum.data());
+        std::vector<double> values = selected_source == SOURCE_LINEAR
+                                         ? spectrum
+                                         : features_of(spectrum);
+        if (values.size() != frame.bins) {
+          return false;
+        }
+        std::copy(values.begin(), values.end(), out);
+        return true;
+      });
+}
+
+// Views are drawn tiled in this order.
+void register_builtin_views() {
+  spectrum_view = registered_views().size();
+  register_view(ViewPlugin{"Spectrum",
+                           FEATURE_SPECTRUM | FEATURE_PITCH | FEATURE_PARTIALS,
+                           spectrogramInit, display_spectrum, spectrum_overlay,
+                           nullptr, 1},
+                false);
+  register_view(ViewPlugin{"Waveform", FEATURE_WAVEFORM, nullptr,
+                           display_waveform, nullptr, nullptr, 0},
+                false);
+  register_view(ViewPlugin{"3D",
+                           FEATURE_SPECTRUM | FEATURE_BEATS | FEATURE_PARTIALS,
+                           plot3dInit, display_3d, nullptr,
+                           plot3dHandleKeyEvent, 0},
+                true);
+  register_view(ViewPlugin{"Waterfall", FEATURE_SPECTRUM, waterfallInit,
+                           display_waterfall, nullptr, nullptr, 0},
+                false);
 }
 
-int main() {
+int main(int argc, char **argv) {
+  start_counter = SDL_GetPerformanceCounter();
+  if (argc > 1 && strcmp(argv[1], "extract") == 0) {
+    return batch_extract(argc - 2, argv + 2);
+  }
+  if (argc > 1 && strcmp(argv[1], "beats") == 0) {
+    return batch_beats(argc - 2, argv + 2);
+  }
+  if (argc > 1 && strcmp(argv[1], "shm-feed") == 0) {
+    return shm_feed(argc - 2, argv + 2);
+  }
+
+  // --pcm FORMAT:RATE:CHANNELS plays raw PCM from stdin, or from the file
+  // or FIFO given by --fifo; --shm NAME attaches to a shared-memory ring.
+  // Any other arguments are files to play in order.
+  const char *pcm_spec = nullptr;
+  const char *fifo_path = nullptr;
+  const char *shm_name = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 < argc && strcmp(argv[i], "--pcm") == 0) {
+      pcm_spec = argv[++i];
+    } else if (i + 1 < argc && strcmp(argv[i], "--fifo") == 0) {
+      fifo_path = argv[++i];
+    } else if (i + 1 < argc && strcmp(argv[i], "--shm") == 0) {
+      shm_name = argv[++i];
+    } else {
+      playlist.add(argv[i]);
+    }
+  }
+
   try {
+    std::unique_ptr<PcmRing> ring;
+    int fd = -1;
+    if (pcm_spec != nullptr) {
+      SDL_AudioFormat format;
+      long rate;
+      int channels;
+      if (!parse_pcm_spec(pcm_spec, format, rate, channels)) {
+        std::cout << "error: --pcm wants FORMAT:RATE:CHANNELS, e.g. "
+                     "s16:44100:2"
+                  << std::endl;
+        return 2;
+      }
+      fd = STDIN_FILENO;
+      if (fifo_path != nullptr) {
+        std::cout << "Waiting for a writer on " << fifo_path << std::endl;
+        fd = open(fifo_path, O_RDONLY);
+        if (fd < 0) {
+          std::stringstream ss;
+          ss << fifo_path << ": " << strerror(errno);
+          throw std::runtime_error(ss.str());
+        }
+      }
+      // Small on purpose: a faster producer is held back by the pipe
+      // rather than queueing up latency here.
+      size_t block = rate / TARGET_FPS * channels * sample_byte_size(format);
+      ring = std::make_unique<PcmRing>(format, channels, rate,
+                                       STREAM_MAX_BLOCKS * block);
+    } else if (shm_name != nullptr) {
+      ring = std::make_unique<PcmRing>(shm_name);
+    }
+
     set_up();
-    selected_visualization = V3D;
+    register_builtin_views();
+    init_views();
+    ScrollbackOptions scrollback_options;
+    scrollback_options.compression = scrollback_compression();
+    scrollback.set_options(scrollback_options);
+    if (ring != nullptr) {
+      open_stream(std::move(ring),
+                  fd, pcm_spec != nullptr
+                          ? (fifo_path != nullptr ? fifo_path : "stdin")
+                          : shm_name);
+    }
+
+    // Without vsync frames are paced to the display's refresh rate.
+    SDL_DisplayMode mode;
+    int refresh_rate = SDL_GetWindowDisplayMode(window, &mode) == 0 &&
+                               mode.refresh_rate > 0
+                           ? mode.refresh_rate
+                           : 60;
+    RenderScheduler scheduler(refresh_rate, SDL_GL_GetSwapInterval() != 0);
+    uint64_t drawn_frame_id = plot_frame_id;
 
     while (!done) {
-      if (audio_finished) {
-        stop_audio();
-        audio_name = nullptr;
-        audio_finished = false;
-        plot_data.clear();
-        plot_fft_input.clear();
-      }
+      advance_playlist();
 
+      bool hidden = SDL_GetWindowFlags(window) &
+                    (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED);
+      int wait_ms = scheduler.wait_ms(hidden);
       SDL_Event event;
-      while (SDL_PollEvent(&event)) {
+      bool got_event = wait_ms > 0 ? SDL_WaitEventTimeout(&event, wait_ms)
+                                   : SDL_PollEvent(&event);
+      for (; got_event; got_event = SDL_PollEvent(&event)) {
+        if (event.type == SDL_USEREVENT) {
+          wakeup_pending = false;
+          continue;
+        }
+        scheduler.invalidate(3);
         ImGui_ImplSDL2_ProcessEvent(&event);
         if (event.type == SDL_QUIT)
           done = true;
+        if (event.type == SDL_DROPFILE) {
+          playlist.add(event.drop.file);
+          SDL_free(event.drop.file);
+        }
         if (event.type == SDL_WINDOWEVENT &&
             event.window.event == SDL_WINDOWEVENT_CLOSE &&
             event.window.windowID == SDL_GetWindowID(window))
@@ -390,21 +1467,49 @@ int main() {
               keyboard_state[SDL_SCANCODE_O]) {
                 select_file();
           }
-          if (selected_visualization == V3D) {
-            plot3dHandleKeyEvent();
-          }
+          views_handle_key();
         }
       }
 
-      imgui_frame();
+      big_lock.lock();
+      uint64_t frame_id = plot_frame_id;
+      scrollback.seal_full_blocks();
+      big_lock.unlock();
+      if (frame_id != drawn_frame_id || playlist.preparing()) {
+        scheduler.invalidate();
+      }
+      if (hidden || !scheduler.due()) {
+        continue;
+      }
+      drawn_frame_id = frame_id;
+      frame_arena.reset();
+
+      AnalysisFrame frame = publish_frame();
+      imgui_frame(frame);
 
       glViewport(0, 0, (int)io->DisplaySize.x, (int)io->DisplaySize.y);
       glClearColor(0, 0, 0, 0);
       glClear(GL_COLOR_BUFFER_BIT);
 
-      draw_visualization();
+      draw_views(frame, io->DisplaySize.x, io->DisplaySize.y);
+      analysis_features = active_features();
       ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
       SDL_GL_SwapWindow(window);
+      scheduler.presented();
+      if (first_frame_ms == 0) {
+        first_frame_ms = 1000.0 *
+                         (SDL_GetPerformanceCounter() - start_counter) /
+                         SDL_GetPerformanceFrequency();
+        const ProgramCacheStats &programs = program_cache_stats();
+        std::cout << "First frame after " << first_frame_ms
+                  << " ms (shaders " << programs.ms << " ms, "
+                  << programs.from_cache << "/" << programs.programs
+                  << " programs from cache)" << std::endl;
+      }
+    }
+    if (dialog_thread.joinable()) {
+      // tinyfd can't be told to close its dialog.
+      dialog_thread.detach();
     }
     clean_up();
   } catch (std::exception &e) {
@@ -0,0 +1,147 @@
+#include "partials.h"
+#include <algorithm>
+#include <cmath>
+
+// Peaks further than this below the frame's strongest aren't tracked.
+static const double PEAK_RANGE = 1e-2; // -40 dB
+// A peak continues a track when it is within this many bins plus
+// RELATIVE_TOLERANCE of the track's frequency.
+static const double BIN_TOLERANCE = 1.5;
+static const double RELATIVE_TOLERANCE = 0.03;
+// Frames a track survives without a matching peak.
+static const int GRACE_FRAMES = 2;
+
+size_t find_peaks(const double *spectrum, size_t bins, double bin_hz,
+                  double min_magnitude, SpectralPeak *out, size_t max_peaks) {
+  size_t found = 0;
+  for (size_t k = 1; k + 1 < bins; k++) {
+    double m = spectrum[k];
+    if (m < min_magnitude || m <= spectrum[k - 1] || m < spectrum[k + 1]) {
+      continue;
+    }
+    if (found == max_peaks && m <= out[found - 1].magnitude) {
+      continue;
+    }
+
+    // Parabola through the log magnitudes around the maximum.
+    double offset = 0, magnitude = m;
+    if (spectrum[k - 1] > 0 && spectrum[k + 1] > 0) {
+      double left = log(spectrum[k - 1]), middle = log(m),
+             right = log(spectrum[k + 1]);
+      double curvature = left - 2 * middle + right;
+      if (curvature < 0) {
+        offset = std::clamp(0.5 * (left - right) / curvature, -0.5, 0.5);
+        magnitude = exp(middle - 0.25 * (left - right) * offset);
+      }
+    }
+
+    // Insertion into the sorted output, dropping the weakest when full.
+    size_t i = found < max_peaks ? found++ : found - 1;
+    for (; i > 0 && out[i - 1].magnitude < magnitude; i--) {
+      out[i] = out[i - 1];
+    }
+    out[i] = SpectralPeak{(k + offset) * bin_hz, magnitude};
+  }
+  return found;
+}
+
+PartialTracker::PartialTracker(size_t history)
+    : history(std::max<size_t>(history, 1)) {
+  table.assign(this->history * MAX_TRACKS, Partial{0, 0, 0});
+}
+
+void PartialTracker::reset() {
+  std::fill(table.begin(), table.end(), Partial{0, 0, 0});
+  head = 0;
+  filled = 0;
+  for (Track &track : tracks) {
+    track = Track();
+  }
+}
+
+const Partial *PartialTracker::row(size_t age) const {
+  return table.data() + ((head + history - age) % history) * MAX_TRACKS;
+}
+
+void PartialTracker::process(const double *spectrum, size_t bins,
+                             double bin_hz) {
+  double strongest =
+      bins != 0 ? *std::max_element(spectrum, spectrum + bins) : 0;
+  size_t num_peaks = find_peaks(spectrum, bins, bin_hz, strongest * PEAK_RANGE,
+                                peaks, MAX_PEAKS);
+
+  // Every (track, peak) pair within tolerance, closest first, is taken
+  // greedily: each track and each peak is used at most once.
+  size_t num_matches = 0;
+  for (size_t t = 0; t < MAX_TRACKS; t++) {
+    if (tracks[t].id == 0) {
+      continue;
+    }
+    double tolerance =
+        BIN_TOLERANCE * bin_hz + RELATIVE_TOLERANCE * tracks[t].frequency;
+    for (size_t p = 0; p < num_peaks; p++) {
+      double distance = std::abs(peaks[p].frequency - tracks[t].frequency);
+      if (distance <= tolerance) {
+        matches[num_matches++] = Match{distance, (uint8_t)t, (uint8_t)p};
+      }
+    }
+  }
+  std::sort(matches, matches + num_matches,
+            [](const Match &a, const Match &b) {
+              return a.distance < b.distance;
+            });
+
+  bool track_matched[MAX_TRACKS] = {};
+  bool peak_used[MAX_PEAKS] = {};
+  head = (head + 1) % history;
+  filled = std::min(filled + 1, history);
+  Partial *current = table.data() + head * MAX_TRACKS;
+  std::fill(current, current + MAX_TRACKS, Partial{0, 0, 0});
+
+  for (size_t i = 0; i < num_matches; i++) {
+    const Match &match = matches[i];
+    if (track_matched[match.track] || peak_used[match.peak]) {
+      continue;
+    }
+    track_matched[match.track] = peak_used[match.peak] = true;
+    Track &track = tracks[match.track];
+    track.frequency = peaks[match.peak].frequency;
+    track.magnitude = peaks[match.peak].magnitude;
+    track.missed = 0;
+  }
+
+  for (size_t t = 0; t < MAX_TRACKS; t++) {
+    if (tracks[t].id != 0 && !track_matched[t] &&
+        ++tracks[t].missed > GRACE_FRAMES) {
+      tracks[t] = Track();
+    }
+  }
+
+  // Peaks come strongest first, so births favour the loud ones when slots
+  // run out.
+  size_t free_slot = 0;
+  for (size_t p = 0; p < num_peaks; p++) {
+    if (peak_used[p]) {
+      continue;
+    }
+    while (free_slot < MAX_TRACKS && tracks[free_slot].id != 0) {
+      free_slot++;
+    }
+    if (free_slot == MAX_TRACKS) {
+      break;
+    }
+    tracks[free_slot] =
+        Track{next_id++, peaks[p].frequency, peaks[p].magnitude, 0};
+    track_matched[free_slot] = true;
+    if (next_id == 0) {
+      next_id = 1;
+    }
+  }
+
+  for (size_t t = 0; t < MAX_TRACKS; t++) {
+    if (track_matched[t]) {
+      current[t] = Partial{tracks[t].id, (float)tracks[t].frequency,
+                           (float)tracks[t].magnitude};
+    }
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef _AUDIO_VISUALIZER_PARTIALS_H_
+#define _AUDIO_VISUALIZER_PARTIALS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const size_t MAX_PEAKS = 32;  // picked per frame
+const size_t MAX_TRACKS = 32; // partials followed at once
+
+struct SpectralPeak {
+  double frequency; // Hz
+  double magnitude;
+};
+
+// Local maxima of spectrum above min_magnitude, refined between bins by a
+// parabola through the log magnitudes (exact for a Gaussian-windowed
+// sinusoid). At most max_peaks are kept, the strongest, written to out
+// sorted by decreasing magnitude. Returns how many were written.
+size_t find_peaks(const double *spectrum, size_t bins, double bin_hz,
+                  double min_magnitude, SpectralPeak *out, size_t max_peaks);
+
+struct Partial {
+  uint32_t id; // 0 for an empty slot
+  float frequency;
+  float magnitude;
+};
+
+// McAulay-Quatieri style partial tracker: peaks of each new frame continue
+// the closest track within a frequency tolerance, unmatched tracks die after
+// a short grace period and unmatched peaks start new tracks. A track keeps
+// its slot for its whole life, so slot s of consecutive rows with the same
+// id is a ridge. All tables are allocated by the constructor.
+class PartialTracker {
+public:
+  explicit PartialTracker(size_t history);
+
+  void reset();
+
+  void process(const double *spectrum, size_t bins, double bin_hz);
+
+  // MAX_TRACKS slots of the frame `age` frames old, age 0 the newest.
+  const Partial *row(size_t age) const;
+  // How many rows hold frames, at most history.
+  size_t rows() const { return filled; }
+
+private:
+  struct Track {
+    uint32_t id = 0;
+    double frequency = 0;
+    double magnitude = 0;
+    int missed = 0;
+  };
+  struct Match {
+    double distance;
+    uint8_t track;
+    uint8_t peak;
+  };
+
+  size_t history;
+  std::vector<Partial> table; // history rows of MAX_TRACKS, ring
+  size_t head = 0;
+  size_t filled = 0;
+
+  Track tracks[MAX_TRACKS];
+  SpectralPeak peaks[MAX_PEAKS];
+  Match matches[MAX_TRACKS * MAX_PEAKS];
+  uint32_t next_id = 1;
+};
+
+#endif
@@ -0,0 +1,143 @@
+#include "pitch.h"
+#include "fft.h"
+#include "plot_utils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// YIN's absolute threshold on the cumulative mean normalized difference.
+static const double YIN_THRESHOLD = 0.15;
+// Windows quieter than this (RMS relative to full scale) aren't analysed.
+static const double MIN_RMS = 1e-3;
+// Below this a period is too short to be resolved, ~5.5 kHz at 44.1 kHz.
+static const size_t MIN_PERIOD = 8;
+
+PitchTracker::PitchTracker() {
+  ring.assign(PITCH_WINDOW, 0);
+  window.assign(PITCH_WINDOW, 0);
+  first_half.assign(PITCH_WINDOW, 0);
+  correlation.assign(PITCH_WINDOW, 0);
+  difference.assign(PITCH_WINDOW / 2, 0);
+}
+
+void PitchTracker::reset(long rate, SDL_AudioFormat format) {
+  this->rate = rate;
+  full_scale = scaleY(1, format) - scaleY(0, format);
+  std::fill(ring.begin(), ring.end(), 0);
+  ring_head = 0;
+  filled = 0;
+  last = PitchReading();
+}
+
+void PitchTracker::push(const double *samples, size_t n) {
+  if (n > PITCH_WINDOW) {
+    samples += n - PITCH_WINDOW;
+    n = PITCH_WINDOW;
+  }
+  size_t first = std::min(n, PITCH_WINDOW - ring_head);
+  std::copy(samples, samples + first, ring.begin() + ring_head);
+  std::copy(samples + first, samples + n, ring.begin());
+  ring_head = (ring_head + n) % PITCH_WINDOW;
+  filled = std::min(filled + n, PITCH_WINDOW);
+}
+
+PitchReading PitchTracker::estimate() {
+  last = PitchReading();
+  if (filled < PITCH_WINDOW) {
+    return last;
+  }
+
+  // Unroll the ring oldest first and take the DC offset out, unsigned
+  // formats carry one.
+  std::copy(ring.begin() + ring_head, ring.end(), window.begin());
+  std::copy(ring.begin(), ring.begin() + ring_head,
+            window.begin() + (PITCH_WINDOW - ring_head));
+  double mean = 0;
+  for (double v : window) {
+    mean += v;
+  }
+  mean /= PITCH_WINDOW;
+  double energy = 0;
+  for (double &v : window) {
+    v -= mean;
+    energy += v * v;
+  }
+  if (std::sqrt(energy / PITCH_WINDOW) * full_scale < MIN_RMS) {
+    return last;
+  }
+
+  // d(tau) = sum_{j < W/2} (x[j] - x[j + tau])^2
+  //        = E(0) + E(tau) - 2 r(tau), E(tau) = sum_{j < W/2} x[j + tau]^2,
+  // with r the correlation of the first half against the whole window. The
+  // first half is zero-padded, and j + tau < W, so nothing wraps around.
+  const size_t half = PITCH_WINDOW / 2;
+  std::copy(window.begin(), window.begin() + half, first_half.begin());
+  std::fill(first_half.begin() + half, first_half.end(), 0);
+  cross_correlation(first_half.data(), window.data(), PITCH_WINDOW,
+                    correlation.data());
+
+  double energy_0 = 0;
+  for (size_t j = 0; j < half; j++) {
+    energy_0 += window[j] * window[j];
+  }
+  // Cumulative mean normalized difference, d'(0) = 1.
+  double energy_tau = energy_0;
+  double running_sum = 0;
+  difference[0] = 1;
+  for (size_t tau = 1; tau < half; tau++) {
+    energy_tau += window[tau + half - 1] * window[tau + half - 1] -
+                  window[tau - 1] * window[tau - 1];
+    double d = std::max(energy_0 + energy_tau - 2 * correlation[tau], 0.0);
+    running_sum += d;
+    difference[tau] = running_sum > 0 ? d * tau / running_sum : 1;
+  }
+
+  // First dip under the threshold, followed down to its minimum; the global
+  // minimum when there is none.
+  size_t period = 0;
+  for (size_t tau = MIN_PERIOD; tau < half; tau++) {
+    if (difference[tau] < YIN_THRESHOLD) {
+      while (tau + 1 < half && difference[tau + 1] < difference[tau]) {
+        tau++;
+      }
+      period = tau;
+      break;
+    }
+  }
+  if (period == 0) {
+    period = std::min_element(difference.begin() + MIN_PERIOD,
+                              difference.end()) -
+             difference.begin();
+  }
+
+  double refined = period;
+  if (period > MIN_PERIOD && period + 1 < half) {
+    double left = difference[period - 1], middle = difference[period],
+           right = difference[period + 1];
+    double curvature = left - 2 * middle + right;
+    if (curvature > 0) {
+      refined += std::clamp(0.5 * (left - right) / curvature, -0.5, 0.5);
+    }
+  }
+
+  last.confidence = std::clamp(1 - difference[period], 0.0, 1.0);
+  last.frequency = rate / refined;
+  return last;
+}
+
+std::string note_name(double frequency) {
+  static const char *NAMES[12] = {"C",  "C#", "D",  "D#", "E",  "F",
+                                  "F#", "G",  "G#", "A",  "A#", "B"};
+  if (frequency <= 0) {
+    return "-";
+  }
+  double midi = 69 + 12 * log2(frequency / 440);
+  long note = std::lround(midi);
+  int cents = std::lround(100 * (midi - note));
+  long name = ((note % 12) + 12) % 12;
+  long octave = (note - name) / 12 - 1;
+
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%s%ld %+dc", NAMES[name], octave, cents);
+  return buffer;
+}
@@ -0,0 +1,56 @@
+#ifndef _AUDIO_VISUALIZER_PITCH_H_
+#define _AUDIO_VISUALIZER_PITCH_H_
+
+#include <SDL_audio.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+const size_t PITCH_WINDOW = 4096;
+
+struct PitchReading {
+  double frequency = 0;  // Hz, 0 when nothing periodic was found
+  double confidence = 0; // 1 - the YIN dip at the period, 0 ... 1
+};
+
+// Monophonic YIN pitch tracker over the last PITCH_WINDOW samples. The
+// difference function is built from one FFT cross-correlation of the first
+// half of the window with all of it (see cross_correlation()) plus running
+// energies, so an update costs three transforms of PITCH_WINDOW instead of
+// a quadratic sum. Periods up to PITCH_WINDOW / 2 are searched.
+class PitchTracker {
+public:
+  PitchTracker();
+
+  void reset(long rate, SDL_AudioFormat format);
+
+  // Appends samples to the window; only the last PITCH_WINDOW are kept.
+  void push(const double *samples, size_t n);
+
+  // Estimates the pitch of the current window.
+  PitchReading estimate();
+
+  PitchReading reading() const { return last; }
+
+private:
+  long rate = 44100;
+  double full_scale = 1.0 / 32768;
+
+  std::vector<double> ring;
+  size_t ring_head = 0; // next write position, also the oldest sample
+  size_t filled = 0;
+
+  // Scratch for estimate(), sized once.
+  std::vector<double> window;
+  std::vector<double> first_half;
+  std::vector<double> correlation;
+  std::vector<double> difference;
+
+  PitchReading last;
+};
+
+// "A4 +3c": the nearest equal-tempered note (A4 = 440 Hz) and the deviation
+// from it in cents.
+std::string note_name(double frequency);
+
+#endif
@@ -0,0 +1,95 @@
+#include "playlist.h"
+#include <iostream>
+#include <stdexcept>
+
+Playlist::Playlist(std::function<void(PlaylistTrack &)> prepare)
+    : prepare(std::move(prepare)) {}
+
+Playlist::~Playlist() {
+  // Cancels a decode in progress, `tasks` then waits for it.
+  generation++;
+}
+
+void Playlist::add(const std::string &path) { queue.push_back(path); }
+
+void Playlist::add_front(const std::string &path) {
+  if (state == PREPARING || next_ready()) {
+    if (repeat && !queue.empty() && queue.back() == preparing_path) {
+      // update() requeues it when it is prepared again.
+      queue.pop_back();
+    }
+    queue.push_front(preparing_path);
+    generation++;
+  }
+  queue.push_front(path);
+}
+
+void Playlist::clear() {
+  queue.clear();
+  generation++;
+  drop_stale();
+}
+
+void Playlist::drop_stale() {
+  int ready = READY;
+  if (ready_generation != generation &&
+      state.compare_exchange_strong(ready, TAKING)) {
+    prepared.reset();
+    state = IDLE;
+  }
+}
+
+void Playlist::update() {
+  drop_stale();
+  if (state == FAILED) {
+    std::cout << "Error reading or opening file " << preparing_path << ": "
+              << error << std::endl;
+    state = IDLE;
+  }
+  if (state != IDLE || queue.empty()) {
+    return;
+  }
+
+  preparing_path = queue.front();
+  queue.pop_front();
+  if (repeat) {
+    queue.push_back(preparing_path);
+  }
+
+  state = PREPARING;
+  decoded = 0;
+  unsigned started = generation;
+  auto fail = [this, started](const std::exception &e) {
+    if (generation == started) {
+      error = e.what();
+      state = FAILED;
+    } else {
+      prepared.reset();
+      state = IDLE;
+    }
+  };
+  tasks.run([this, path = preparing_path, started, fail] {
+    try {
+      prepared = std::make_unique<PlaylistTrack>();
+      prepared->path = path;
+      prepared->pcm = from_mp3(path.c_str(), [this, started](double done) {
+        decoded = done;
+        return generation == started;
+      });
+    } catch (std::exception &e) {
+      fail(e);
+      return;
+    }
+    tasks.run(
+        [this, started, fail] {
+          try {
+            prepare(*prepared);
+            ready_generation = started;
+            state = READY;
+          } catch (std::exception &e) {
+            fail(e);
+          }
+        },
+        ThreadPool::PRIORITY_BACKGROUND);
+  });
+}
@@ -0,0 +1,107 @@
+#ifndef _AUDIO_VISUALIZER_PLAYLIST_H_
+#define _AUDIO_VISUALIZER_PLAYLIST_H_
+
+#include "converter.h"
+#include "spectrum_store.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+
+struct PlaylistTrack {
+  std::string path;
+  PCM_data pcm;
+  std::unique_ptr<SpectrumStore> store;
+};
+
+// Queue of files to play next. While the current track plays, the head of
+// the queue is decoded on the shared thread pool and then prepared by the
+// `prepare` hook in its background lane, so that the audio callback can pick
+// it up without waiting.
+//
+// The queue itself belongs to the UI thread. The prepared track is handed
+// over through an atomic state, so next_ready() and take() are lock-free and
+// safe to call from the audio callback.
+class Playlist {
+public:
+  explicit Playlist(std::function<void(PlaylistTrack &)> prepare);
+  ~Playlist();
+
+  Playlist(const Playlist &) = delete;
+  Playlist &operator=(const Playlist &) = delete;
+
+  void add(const std::string &path);
+  // Puts `path` ahead of everything, including a track that is being
+  // prepared or ready, which is queued again right behind it.
+  void add_front(const std::string &path);
+  // Drops the queue and a prepared track that hasn't been taken yet, and
+  // cancels the one being decoded.
+  void clear();
+
+  // Call from the UI thread every frame: starts preparing the next track
+  // when nothing is being prepared, and reports tracks that failed.
+  void update();
+
+  bool next_ready() const {
+    return state == READY && ready_generation == generation;
+  }
+  // Hands over the prepared track, nullptr when there is none or `accept`
+  // turns it down; then it stays ready. The track can't be dropped while
+  // `accept` looks at it.
+  template <typename Accept>
+  std::unique_ptr<PlaylistTrack> take(const Accept &accept) {
+    int ready = READY;
+    if (!state.compare_exchange_strong(ready, TAKING)) {
+      return nullptr;
+    }
+    if (ready_generation != generation || !accept(*prepared)) {
+      state = READY;
+      return nullptr;
+    }
+    std::unique_ptr<PlaylistTrack> track = std::move(prepared);
+    state = IDLE;
+    return track;
+  }
+  std::unique_ptr<PlaylistTrack> take() {
+    return take([](const PlaylistTrack &) { return true; });
+  }
+
+  // Nothing queued or being prepared.
+  bool empty() const { return queue.empty() && state == IDLE; }
+  bool preparing() const { return state == PREPARING; }
+  // Decoded fraction of the track being prepared, -1 when unknown.
+  double progress() const { return decoded; }
+  const std::deque<std::string> &queued() const { return queue; }
+  const std::string &next_path() const { return preparing_path; }
+
+  // Puts every track that starts playing back at the end of the queue.
+  bool repeat = false;
+
+private:
+  enum State { IDLE, PREPARING, READY, TAKING, FAILED };
+
+  // Drops a prepared track of an older generation. The track is only
+  // freed once it is claimed (READY to TAKING), like take() does, so never
+  // under a callback that is looking at it.
+  void drop_stale();
+
+  std::function<void(PlaylistTrack &)> prepare;
+  std::deque<std::string> queue;
+  std::string preparing_path;
+  std::string error;
+
+  // Owned by the tasks while PREPARING.
+  std::unique_ptr<PlaylistTrack> prepared;
+  std::atomic<int> state{IDLE};
+  std::atomic<double> decoded{0};
+  // Bumped by clear() and add_front(), a worker of an older generation gives
+  // up and a track it prepared anyway is dropped.
+  std::atomic<unsigned> generation{0};
+  std::atomic<unsigned> ready_generation{0};
+  // Last, so that it waits for the tasks before anything they use goes.
+  TaskGroup tasks{shared_pool()};
+};
+
+#endif
@@ -1,11 +1,15 @@
 #include "plot3d.h"
 #include "SDL_scancode.h"
 #include "fft.h"
+#include "frame_arena.h"
 #include "global.h"
 #include "plot_utils.h"
 #include "shader_utils.h"
+#include "thread_pool.h"
 #include <SDL.h>
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
@@ -14,13 +18,41 @@
 
 static const char *VERTEX_SHADER = "plot3d.vertex.glsl";
 static const char *FRAGMENT_SHADER = "plot3d.fragment.glsl";
+static const char *RIDGE_VERTEX_SHADER = "ridge.vertex.glsl";
+static const char *RIDGE_FRAGMENT_SHADER = "ridge.fragment.glsl";
 
 static const float SQRT_MAX_FFT_OUTPUT = sqrt(MAX_FFT_OUTPUT);
 
 static GLuint program;
-static GLint attribute_coord3d;
+static GLint attribute_grid;
+static GLint attribute_height;
 static GLint uniform_vertex_transform;
-static GLuint vbo;
+static GLint uniform_head;
+static GLint uniform_rows;
+static GLint uniform_pulse;
+
+static GLuint ridge_program;
+static GLint ridge_attribute_position;
+static GLint ridge_attribute_strength;
+static GLint ridge_uniform_vertex_transform;
+static GLuint ridge_vbo;
+// Lifts ridges above the surface they follow so they aren't depth-fought.
+static const float RIDGE_LIFT = 0.02;
+
+// The surface is a ring of HISTORY rows x N bins. grid_vbo (x, ring slot)
+// and ibo only change with the grid size; every frame just the heights of
+// the new rows are written into height_vbo and `head` is moved, the vertex
+// shader turns ring slots into depth.
+static GLuint grid_vbo;
+static GLuint height_vbo;
+static GLuint ibo;
+static bool primitive_restart;
+static const GLuint RESTART_INDEX = 0xFFFFFFFF;
+
+static size_t grid_bins = 0;
+static size_t grid_rows = 0;
+static size_t head = 0;
+static uint64_t uploaded_frame_id = 0;
 
 static const float DRAW_DISTANCE = 10.0;
 
@@ -41,66 +73,276 @@ static glm::vec3 eye_from_angles() {
 void plot3dInit() {
   program = create_program(VERTEX_SHADER, FRAGMENT_SHADER);
   if (program == 0) {
-    throw std::runtime_error("couldnt't create plot3d program");
+    throw std::runtime_error("couldn't create plot3d program");
   }
-  glGenBuffers(1, &vbo);
+  glGenBuffers(1, &grid_vbo);
+  glGenBuffers(1, &height_vbo);
+  glGenBuffers(1, &ibo);
+  primitive_restart = GLAD_GL_VERSION_3_1;
 
-  attribute_coord3d = get_attrib(program, "coord3d");
+  attribute_grid = get_attrib(program, "grid");
+  attribute_height = get_attrib(program, "height");
   uniform_vertex_transform = get_uniform(program, "vertex_transform");
+  uniform_head = get_uniform(program, "head");
+  uniform_rows = get_uniform(program, "rows");
+  uniform_pulse = get_uniform(program, "pulse");
 
-  if (attribute_coord3d == -1 || uniform_vertex_transform == -1) {
-    throw std::runtime_error("couldnt't get attribute");
+  ridge_program = create_program(RIDGE_VERTEX_SHADER, RIDGE_FRAGMENT_SHADER);
+  if (ridge_program == 0) {
+    throw std::runtime_error("couldn't create ridge program");
   }
+  ridge_attribute_position = get_attrib(ridge_program, "position");
+  ridge_attribute_strength = get_attrib(ridge_program, "strength");
+  ridge_uniform_vertex_transform =
+      get_uniform(ridge_program, "vertex_transform");
+  glGenBuffers(1, &ridge_vbo);
 }
 
-void plot3dDisplay(const std::vector<double> &fftLabels,
-                   const std::deque<std::vector<double>> &fftValues,
-                   SDL_AudioFormat fmt) {
-  const size_t N = fftLabels.size();
-  for (auto fftValueVector : fftValues) {
-    if (fftValueVector.size() != N) {
-      // Batch of values that is shorter than labels.
-      // Let's ignore it - it's probably the last one in the file.
-      return;
+static glm::mat4 vertex_transform() {
+  glm::mat4 model = glm::mat4(1.0f);
+  glm::mat4 view = glm::lookAt(eye_from_angles(), glm::vec3(0.0, 0.0, 0.0),
+                               glm::vec3(0.0, 1.0, 0.0));
+  glm::mat4 projection = glm::perspective(45.0f, 1.0f, 0.1f, DRAW_DISTANCE);
+  return projection * view * model;
+}
+
+static float height_of(double magnitude) {
+  return 2.0 * sqrt(magnitude) / SQRT_MAX_FFT_OUTPUT - 1.0;
+}
+
+static size_t strip_length() { return 2 * grid_bins + 1; }
+
+static void build_grid(const double *fftLabels, size_t fftN, size_t rows) {
+  grid_bins = fftN;
+  grid_rows = rows;
+  head = 0;
+
+  const double labelSpan = span(fftLabels, fftN);
+  std::vector<glm::vec2> grid(grid_rows * grid_bins);
+  for (size_t j = 0; j < grid_rows; j++) {
+    for (size_t i = 0; i < grid_bins; i++) {
+      grid[j * grid_bins + i] =
+          glm::vec2(2.0 * fftLabels[i] / labelSpan - 1.0, j);
     }
   }
-  const size_t M = fftValues.size();
-  const double labelSpan = span(fftLabels.data(), fftLabels.size());
+  glBindBuffer(GL_ARRAY_BUFFER, grid_vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * grid.size(), grid.data(),
+               GL_STATIC_DRAW);
+
+  glBindBuffer(GL_ARRAY_BUFFER, height_vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(float) * grid_rows * grid_bins,
+               nullptr, GL_DYNAMIC_DRAW);
 
-  glm::vec3 vertices[N][M];
-  for (int i = 0; i < N; i++) {
-    for (int j = 0; j < M; j++) {
-      vertices[i][j].x = 2.0 * fftLabels[i] / labelSpan - 1.0;
-      vertices[i][j].y =
-          2.0 * sqrt(fftValues[j][i]) / SQRT_MAX_FFT_OUTPUT - 1.0;
-      vertices[i][j].z = 1.0 - 2.0 * j / M;
+  // Strip j joins ring slots j and j + 1; each strip ends with a restart
+  // index so any run of consecutive strips is one draw call.
+  std::vector<GLuint> indices;
+  indices.reserve(grid_rows * strip_length());
+  for (size_t j = 0; j < grid_rows; j++) {
+    size_t next = (j + 1) % grid_rows;
+    for (size_t i = 0; i < grid_bins; i++) {
+      indices.push_back(j * grid_bins + i);
+      indices.push_back(next * grid_bins + i);
     }
+    indices.push_back(RESTART_INDEX);
   }
-  big_lock.unlock();
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(),
+               indices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+static void fill_row(const std::vector<double> *values, float *row_heights) {
+  for (size_t i = 0; i < grid_bins; i++) {
+    // Rows of a different size (the last batch of a file) or not yet filled
+    // stay at the bottom, where the fragment shader discards them.
+    row_heights[i] =
+        values != nullptr && values->size() == grid_bins
+            ? height_of((*values)[i])
+            : -1.0;
+  }
+}
 
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof vertices, vertices, GL_STATIC_DRAW);
+static void upload_row(size_t slot, const std::vector<double> *values,
+                       float *row_heights) {
+  fill_row(values, row_heights);
+  glBufferSubData(GL_ARRAY_BUFFER, sizeof(float) * slot * grid_bins,
+                  sizeof(float) * grid_bins, row_heights);
+}
+
+// Rewrites the whole ring with head at slot 0. The rows are converted on the
+// pool in chunks and go up in a single upload.
+static void upload_all(const std::deque<std::vector<double>> &fftValues) {
+  head = 0;
+  float *heights = frame_arena.alloc<float>(grid_rows * grid_bins);
+  ThreadPool &pool = shared_pool();
+  size_t chunk = (grid_rows + pool.size()) / (pool.size() + 1);
+  TaskGroup rows(pool, ThreadPool::PRIORITY_REALTIME);
+  for (size_t first = 0; first < grid_rows; first += chunk) {
+    size_t last = std::min(first + chunk, grid_rows);
+    rows.run([&fftValues, heights, first, last] {
+      for (size_t k = first; k < last; k++) {
+        size_t slot = (grid_rows - k) % grid_rows;
+        fill_row(k < fftValues.size() ? &fftValues[k] : nullptr,
+                 heights + slot * grid_bins);
+      }
+    });
+  }
+  rows.wait();
+  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * grid_rows * grid_bins,
+                  heights);
+}
+
+static void draw_strips(size_t first, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  if (primitive_restart) {
+    glDrawElements(GL_TRIANGLE_STRIP, count * strip_length(), GL_UNSIGNED_INT,
+                   (void *)(sizeof(GLuint) * first * strip_length()));
+    return;
+  }
+  for (size_t j = first; j < first + count; j++) {
+    glDrawElements(GL_TRIANGLE_STRIP, strip_length() - 1, GL_UNSIGNED_INT,
+                   (void *)(sizeof(GLuint) * j * strip_length()));
+  }
+}
+
+void plot3dDisplay(const double *fftLabels, size_t fftN,
+                   const std::deque<std::vector<double>> &fftValues,
+                   uint64_t newestFrameId, size_t historySize,
+                   SDL_AudioFormat fmt, float beatPulse) {
+  if (fftN < 2 || historySize < 2) {
+    big_lock.unlock();
+    return;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, height_vbo);
+  size_t newRows = newestFrameId - uploaded_frame_id;
+  if (fftN != grid_bins || historySize != grid_rows) {
+    build_grid(fftLabels, fftN, historySize);
+    glBindBuffer(GL_ARRAY_BUFFER, height_vbo);
+    newRows = grid_rows;
+  }
+  if (newRows >= grid_rows) {
+    // Everything changed.
+    upload_all(fftValues);
+  } else {
+    float *rowHeights = frame_arena.alloc<float>(grid_bins);
+    newRows = std::min(newRows, fftValues.size());
+    head = (head + newRows) % grid_rows;
+    for (size_t k = 0; k < newRows; k++) {
+      upload_row((head + grid_rows - k) % grid_rows, &fftValues[k],
+                 rowHeights);
+    }
+  }
+  uploaded_frame_id = newestFrameId;
+  big_lock.unlock();
 
   glUseProgram(program);
 
-  glm::mat4 model = glm::mat4(1.0f);
-  glm::mat4 view = glm::lookAt(eye_from_angles(), glm::vec3(0.0, 0.0, 0.0),
-                               glm::vec3(0.0, 1.0, 0.0));
-  glm::mat4 projection = glm::perspective(45.0f, 1.0f, 0.1f, DRAW_DISTANCE);
-  glm::mat4 vertex_transform = projection * view * model;
+  glm::mat4 transform = vertex_transform();
   glUniformMatrix4fv(uniform_vertex_transform, 1, GL_FALSE,
-                     glm::value_ptr(vertex_transform));
+                     glm::value_ptr(transform));
+  glUniform1f(uniform_head, head);
+  glUniform1f(uniform_rows, grid_rows);
+  glUniform1f(uniform_pulse, beatPulse);
 
-  glEnableVertexAttribArray(attribute_coord3d);
+  glEnableVertexAttribArray(attribute_grid);
+  glBindBuffer(GL_ARRAY_BUFFER, grid_vbo);
+  glVertexAttribPointer(attribute_grid, 2, GL_FLOAT, GL_FALSE, 0, 0);
+  glEnableVertexAttribArray(attribute_height);
+  glBindBuffer(GL_ARRAY_BUFFER, height_vbo);
+  glVertexAttribPointer(attribute_height, 1, GL_FLOAT, GL_FALSE, 0, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
 
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glVertexAttribPointer(attribute_coord3d, 3, GL_FLOAT, GL_FALSE, 0, 0);
+  if (primitive_restart) {
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(RESTART_INDEX);
+  }
+  glClear(GL_DEPTH_BUFFER_BIT);
+  glEnable(GL_DEPTH_TEST);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glEnable(GL_BLEND);
+  // Strip `head` would join the newest row to the oldest one, skip it.
+  draw_strips(0, head);
+  draw_strips(head + 1, grid_rows - head - 1);
+  glDisable(GL_BLEND);
+  glDisable(GL_DEPTH_TEST);
+  if (primitive_restart) {
+    glDisable(GL_PRIMITIVE_RESTART);
+  }
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glDisableVertexAttribArray(attribute_grid);
+  glDisableVertexAttribArray(attribute_height);
+}
+
+struct RidgeVertex {
+  glm::vec3 position;
+  float strength;
+};
+
+void plot3dDisplayRidges(const PartialTracker &partials, double maxFrequency) {
+  if (grid_rows < 2 || maxFrequency <= 0 || partials.rows() < 2) {
+    big_lock.unlock();
+    return;
+  }
+
+  // A segment joins slot s of two consecutive rows held by the same track.
+  size_t rows = std::min(partials.rows(), grid_rows);
+  RidgeVertex *vertices =
+      frame_arena.alloc<RidgeVertex>(2 * (rows - 1) * MAX_TRACKS);
+  size_t count = 0;
+  for (size_t age = 0; age + 1 < rows; age++) {
+    const Partial *newer = partials.row(age);
+    const Partial *older = partials.row(age + 1);
+    for (size_t s = 0; s < MAX_TRACKS; s++) {
+      if (newer[s].id == 0 || newer[s].id != older[s].id) {
+        continue;
+      }
+      const Partial *ends[2] = {&newer[s], &older[s]};
+      for (int e = 0; e < 2; e++) {
+        float z = 1.0 - 2.0 * (age + e) / grid_rows;
+        float x = 2.0 * ends[e]->frequency / maxFrequency - 1.0;
+        float y = height_of(ends[e]->magnitude) + RIDGE_LIFT;
+        // Older segments fade out like the surface does.
+        vertices[count++] = RidgeVertex{glm::vec3(x, y, z),
+                                        1.0f - (float)(age + e) / grid_rows};
+      }
+    }
+  }
+  big_lock.unlock();
+  if (count == 0) {
+    return;
+  }
 
-  glPointSize(4.0);
+  glUseProgram(ridge_program);
+  glm::mat4 transform = vertex_transform();
+  glUniformMatrix4fv(ridge_uniform_vertex_transform, 1, GL_FALSE,
+                     glm::value_ptr(transform));
+
+  glBindBuffer(GL_ARRAY_BUFFER, ridge_vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(RidgeVertex) * count, vertices,
+               GL_STREAM_DRAW);
+  glEnableVertexAttribArray(ridge_attribute_position);
+  glVertexAttribPointer(ridge_attribute_position, 3, GL_FLOAT, GL_FALSE,
+                        sizeof(RidgeVertex), 0);
+  glEnableVertexAttribArray(ridge_attribute_strength);
+  glVertexAttribPointer(ridge_attribute_strength, 1, GL_FLOAT, GL_FALSE,
+                        sizeof(RidgeVertex),
+                        (void *)offsetof(RidgeVertex, strength));
+
+  // The depth buffer still holds the surface, lines behind it stay hidden.
+  glEnable(GL_DEPTH_TEST);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   glEnable(GL_BLEND);
-  glDrawArrays(GL_POINTS, vbo, M * N);
+  glLineWidth(1.5);
+  glDrawArrays(GL_LINES, 0, count);
   glDisable(GL_BLEND);
+  glDisable(GL_DEPTH_TEST);
+
+  glDisableVertexAttribArray(ridge_attribute_position);
+  glDisableVertexAttribArray(ridge_attribute_strength);
 }
 
 void plot3dHandleKeyEvent() {
@@ -1,4 +1,5 @@
 varying vec3 model_coord;
+uniform float pulse;
 
 #define LIMIT1 0.037
 #define LIMIT2 0.050
@@ -12,7 +13,16 @@ varying vec3 model_coord;
 #define COLOR5 vec3(255, 128, 0)
 #define COLOR6 vec3(255, 0, 0)
 
+#define LIGHT_DIR normalize(vec3(0.3, 1.0, 0.5))
+#define AMBIENT 0.35
+#define PULSE_GAIN 0.6
+
 void main(void) {
+	// Flat face normal from the screen-space derivatives of the surface,
+	// taken before any discard so the derivatives stay defined.
+	vec3 normal = normalize(cross(dFdx(model_coord), dFdy(model_coord)));
+	float light = AMBIENT + (1.0 - AMBIENT) * abs(dot(normal, LIGHT_DIR));
+
 	if (model_coord.x == 0.0 && model_coord.y == 0.0 && model_coord.z == 0.0) {
 		discard;
 	}
@@ -32,5 +42,7 @@ void main(void) {
 	} else {
 		color = COLOR6;
 	}
-	gl_FragColor = vec4(color, 5 * (model_coord.z + 1.0));
+	// Beats wash the colors towards white.
+	color = mix(min(color, 1.0), vec3(1.0), PULSE_GAIN * pulse);
+	gl_FragColor = vec4(color * light, 5 * (model_coord.z + 1.0));
 }
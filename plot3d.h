@@ -3,14 +3,28 @@
 
 #include "SDL_audio.h"
 #include "SDL_events.h"
+#include "partials.h"
+#include <cstdint>
 #include <deque>
 #include <vector>
 
 void plot3dInit();
 
-void plot3dDisplay(const std::vector<double> &fftLabels,
+// fftValues holds the history, newest first. newestFrameId identifies
+// fftValues.front(): it grows by one per analysed frame and by more than
+// historySize whenever the whole history is replaced, so only rows that are
+// new since the last call get uploaded. beatPulse (0 ... 1) brightens the
+// surface, see BeatTracker::pulse().
+void plot3dDisplay(const double *fftLabels, size_t fftN,
                    const std::deque<std::vector<double>> &fftValues,
-                   SDL_AudioFormat fmt);
+                   uint64_t newestFrameId, size_t historySize,
+                   SDL_AudioFormat fmt, float beatPulse);
+
+// Draws the tracks of `partials` as lines over the surface drawn by the last
+// plot3dDisplay(), for linear spectra whose last bin is at maxFrequency. Row
+// ages of partials must match the history passed to plot3dDisplay(). Call
+// with big_lock held, it is released once the lines are built.
+void plot3dDisplayRidges(const PartialTracker &partials, double maxFrequency);
 
 void plot3dHandleKeyEvent();
 
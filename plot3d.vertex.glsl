@@ -1,8 +1,13 @@
-attribute vec3 coord3d;
+attribute vec2 grid;
+attribute float height;
 varying vec3 model_coord;
 uniform mat4 vertex_transform;
+uniform float head;
+uniform float rows;
 
 void main(void) {
-	model_coord = coord3d;
+	// grid.y is the ring slot of the row, the newest row (at `head`) is in front.
+	float age = mod(head - grid.y + rows, rows);
+	model_coord = vec3(grid.x, height, 1.0 - 2.0 * age / rows);
 	gl_Position = vertex_transform * vec4(model_coord, 1);
 }
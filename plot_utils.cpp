@@ -26,3 +26,31 @@ double span(const double *data, size_t n) {
   }
   return max - min;
 }
+
+GLuint gradient_texture(const GradientStop *stops, size_t n) {
+  const size_t GRADIENT_SIZE = 256;
+  uint8_t gradient[GRADIENT_SIZE][4];
+  size_t stop = 0;
+  for (size_t i = 0; i < GRADIENT_SIZE; i++) {
+    float level = (float)i / (GRADIENT_SIZE - 1);
+    while (stop + 2 < n && stops[stop + 1].level < level) {
+      stop++;
+    }
+    const GradientStop &low = stops[stop], &high = stops[stop + 1];
+    float t = (level - low.level) / (high.level - low.level);
+    for (int c = 0; c < 3; c++) {
+      gradient[i][c] = 255 * (low.rgb[c] + t * (high.rgb[c] - low.rgb[c]));
+    }
+    gradient[i][3] = 255;
+  }
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, GRADIENT_SIZE, 1, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, gradient);
+  return texture;
+}
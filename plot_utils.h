@@ -2,9 +2,20 @@
 #define _AUDIO_VISUALIZER_PLOT_UTILS_H_
 
 #include "SDL_audio.h"
+#include "gl.h"
+#include <cstddef>
+
+struct GradientStop {
+  float level;
+  float rgb[3];
+};
 
 double scaleY(double y, SDL_AudioFormat format);
 
 double span(const double *data, size_t n);
 
+// A linearly filtered 1D lookup texture running through `stops`, ordered
+// by level from 0 to 1.
+GLuint gradient_texture(const GradientStop *stops, size_t n);
+
 #endif
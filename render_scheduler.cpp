@@ -0,0 +1,44 @@
+#include "render_scheduler.h"
+#include <algorithm>
+#include <cmath>
+
+RenderScheduler::RenderScheduler(double max_fps, bool vsync)
+    : period(SDL_GetPerformanceFrequency() / std::max(max_fps, 1.0)),
+      vsync(vsync) {}
+
+void RenderScheduler::invalidate(int frames) {
+  pending = std::max(pending, frames);
+}
+
+bool RenderScheduler::due() const {
+  if (pending == 0) {
+    return false;
+  }
+  return vsync || SDL_GetPerformanceCounter() - last_present >= period;
+}
+
+int RenderScheduler::wait_ms(bool hidden) const {
+  if (hidden) {
+    return HIDDEN_TICK_MS;
+  }
+  if (pending == 0) {
+    return IDLE_TICK_MS;
+  }
+  if (vsync) {
+    return 0;
+  }
+  // Sleep off the rest of the frame, still waking up for input.
+  Uint64 elapsed = SDL_GetPerformanceCounter() - last_present;
+  if (elapsed >= period) {
+    return 0;
+  }
+  return (int)std::ceil(1000.0 * (period - elapsed) /
+                        SDL_GetPerformanceFrequency());
+}
+
+void RenderScheduler::presented() {
+  last_present = SDL_GetPerformanceCounter();
+  if (pending > 0) {
+    pending--;
+  }
+}
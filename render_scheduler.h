@@ -0,0 +1,35 @@
+#ifndef _AUDIO_VISUALIZER_RENDER_SCHEDULER_H_
+#define _AUDIO_VISUALIZER_RENDER_SCHEDULER_H_
+
+#include <SDL.h>
+
+// Decides when the main loop draws. Frames are only drawn after something
+// invalidated them (input, new analysis frames, an animated widget), at most
+// max_fps times per second when the driver doesn't pace swaps (vsync off).
+// In between the loop blocks in SDL_WaitEventTimeout, waking up every
+// IDLE_TICK_MS (HIDDEN_TICK_MS while the window is hidden) for housekeeping.
+class RenderScheduler {
+public:
+  RenderScheduler(double max_fps, bool vsync);
+
+  // Draw the next `frames` frames. ImGui needs a couple of frames to settle
+  // after input.
+  void invalidate(int frames = 1);
+  // A frame should be drawn now.
+  bool due() const;
+  // How long the loop may wait for events.
+  int wait_ms(bool hidden) const;
+  // Call after SDL_GL_SwapWindow.
+  void presented();
+
+  static const int IDLE_TICK_MS = 100;
+  static const int HIDDEN_TICK_MS = 250;
+
+private:
+  Uint64 period; // performance counter ticks per frame
+  bool vsync;
+  int pending = 1;
+  Uint64 last_present = 0;
+};
+
+#endif
@@ -0,0 +1,5 @@
+varying float f_strength;
+
+void main(void) {
+	gl_FragColor = vec4(1.0, 1.0, 1.0, f_strength);
+}
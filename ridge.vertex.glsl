@@ -0,0 +1,9 @@
+attribute vec3 position;
+attribute float strength;
+varying float f_strength;
+uniform mat4 vertex_transform;
+
+void main(void) {
+	gl_Position = vertex_transform * vec4(position, 1);
+	f_strength = strength;
+}
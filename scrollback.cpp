@@ -0,0 +1,155 @@
+#include "scrollback.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// Neighbouring frames are alike: their differences compress far better
+// than the frames themselves. Differences wrap around like the samples.
+template <typename T> static void delta_rows(T *values, size_t n, size_t row) {
+  for (size_t i = n; i-- > row;) {
+    values[i] -= values[i - row];
+  }
+}
+
+template <typename T>
+static void undelta_rows(T *values, size_t n, size_t row) {
+  for (size_t i = row; i < n; i++) {
+    values[i] += values[i - row];
+  }
+}
+
+void Scrollback::push(const std::vector<double> &spectrum, size_t bins) {
+  if (bins != num_bins) {
+    clear();
+    num_bins = bins;
+  }
+  if (num_bins == 0) {
+    return;
+  }
+  size_t n = std::min(spectrum.size(), num_bins);
+  for (size_t i = 0; i < n; i++) {
+    open.push_back(std::log1p(std::max(spectrum[i], 0.0)));
+  }
+  open.resize(open.size() + num_bins - n, 0);
+  next_frame++;
+  frames++;
+}
+
+void Scrollback::seal_full_blocks() {
+  size_t block = SCROLLBACK_BLOCK * num_bins;
+  size_t sealed = 0;
+  while (block != 0 && open.size() - sealed >= block) {
+    seal(open.data() + sealed);
+    sealed += block;
+  }
+  open.erase(open.begin(), open.begin() + sealed);
+  // Room for what push() adds until the next call.
+  open.reserve(SCROLLBACK_OPEN_BLOCKS * block);
+  trim();
+}
+
+void Scrollback::clear() {
+  blocks.clear();
+  open.clear();
+  frames = 0;
+  stored_bytes = 0;
+  num_bins = 0;
+  cached_block = UINT64_MAX;
+}
+
+size_t Scrollback::memory() const {
+  return stored_bytes + sizeof(Block) * blocks.size() +
+         sizeof(float) * open.capacity() + cache.capacity();
+}
+
+void Scrollback::set_options(const ScrollbackOptions &new_options) {
+  options = new_options;
+  trim();
+}
+
+void Scrollback::seal(const float *logs) {
+  size_t n = SCROLLBACK_BLOCK * num_bins;
+  Block block;
+  block.sample_bits = options.sample_bits == 16 ? 16 : 8;
+  block.compression = store_compression_supported(options.compression)
+                          ? options.compression
+                          : STORE_RAW;
+  block.raw_size = n * block.sample_bits / 8;
+  std::vector<uint8_t> raw(block.raw_size);
+  quantize_log_magnitudes(logs, n, block.sample_bits, raw.data(),
+                          block.log_min, block.log_scale);
+  if (block.compression == STORE_RAW) {
+    block.data = std::move(raw);
+  } else {
+    if (block.sample_bits == 16) {
+      delta_rows(reinterpret_cast<uint16_t *>(raw.data()), n, num_bins);
+    } else {
+      delta_rows(raw.data(), n, num_bins);
+    }
+    block.data = compress_chunk(raw, block.compression);
+    block.data.shrink_to_fit();
+  }
+  stored_bytes += block.data.size();
+  blocks.push_back(std::move(block));
+}
+
+void Scrollback::trim() {
+  while (!blocks.empty() && memory() > options.budget_bytes) {
+    stored_bytes -= blocks.front().data.size();
+    blocks.pop_front();
+    frames -= SCROLLBACK_BLOCK;
+  }
+}
+
+const uint8_t *Scrollback::block_data(size_t index) {
+  const Block &block = blocks[index];
+  if (block.compression == STORE_RAW) {
+    return block.data.data();
+  }
+  uint64_t block_first = first() + index * SCROLLBACK_BLOCK;
+  if (cached_block != block_first) {
+    cache.resize(block.raw_size);
+    decompress_chunk(block.data.data(), block.data.size(), block.raw_size,
+                     block.compression, cache.data());
+    size_t n = SCROLLBACK_BLOCK * num_bins;
+    if (block.sample_bits == 16) {
+      undelta_rows(reinterpret_cast<uint16_t *>(cache.data()), n, num_bins);
+    } else {
+      undelta_rows(cache.data(), n, num_bins);
+    }
+    cached_block = block_first;
+  }
+  return cache.data();
+}
+
+void Scrollback::read_frame(uint64_t frame, double *out) {
+  if (frame < first() || frame >= end()) {
+    throw std::out_of_range("scrollback: frame out of range");
+  }
+  size_t offset = frame - first();
+  size_t index = offset / SCROLLBACK_BLOCK;
+  size_t row = offset % SCROLLBACK_BLOCK;
+  if (index >= blocks.size()) {
+    const float *logs =
+        open.data() + (offset - blocks.size() * SCROLLBACK_BLOCK) * num_bins;
+    for (size_t i = 0; i < num_bins; i++) {
+      out[i] = std::expm1(logs[i]);
+    }
+    return;
+  }
+
+  const Block &block = blocks[index];
+  const uint8_t *values = block_data(index);
+  if (block.sample_bits == 16) {
+    const uint16_t *row16 =
+        reinterpret_cast<const uint16_t *>(values) + row * num_bins;
+    for (size_t i = 0; i < num_bins; i++) {
+      out[i] = std::expm1(block.log_min + block.log_scale * row16[i]);
+    }
+  } else {
+    const uint8_t *row8 = values + row * num_bins;
+    for (size_t i = 0; i < num_bins; i++) {
+      out[i] = std::expm1(block.log_min + block.log_scale * row8[i]);
+    }
+  }
+}
@@ -0,0 +1,82 @@
+#ifndef _AUDIO_VISUALIZER_SCROLLBACK_H_
+#define _AUDIO_VISUALIZER_SCROLLBACK_H_
+
+#include "spectrum_store.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Frames per block: the unit that is quantized, compressed and dropped.
+const size_t SCROLLBACK_BLOCK = 64;
+// Blocks push() has room for before seal_full_blocks() catches up.
+const size_t SCROLLBACK_OPEN_BLOCKS = 4;
+
+struct ScrollbackOptions {
+  size_t budget_bytes = 32 << 20;
+  uint32_t sample_bits = 8;
+  // A StoreCompression for full blocks, STORE_RAW unless compiled in.
+  uint32_t compression = STORE_RAW;
+};
+
+// Minutes of analysed spectra for scrubbing back through, within a memory
+// budget. Frames are kept as log1p-magnitudes like in the spectrum store:
+// the newest frames stay float until seal_full_blocks() quantizes each full
+// block to 8 or 16 bits against its own range and, optionally, compresses
+// its row-to-row deltas. The oldest blocks are dropped to stay within the
+// budget. push() only appends, so that the audio callback doesn't quantize,
+// compress or free anything while the format stays the same.
+//
+// Frames are numbered from 0 for the first one ever pushed, so a number
+// keeps meaning the same frame while newer ones arrive. Not thread-safe.
+class Scrollback {
+public:
+  // `bins` is the frame size of the audio the spectrum belongs to; when it
+  // changes, the kept frames are dropped. Spectra of short blocks (the last
+  // one of a file) are cut off or padded with silence to it.
+  void push(const std::vector<double> &spectrum, size_t bins);
+  // Call regularly from outside the audio callback.
+  void seal_full_blocks();
+  void clear();
+
+  // Frames first() ... end() - 1 are kept.
+  uint64_t first() const { return next_frame - frames; }
+  uint64_t end() const { return next_frame; }
+  size_t bins() const { return num_bins; }
+  size_t memory() const;
+
+  // Writes bins() magnitudes of a kept frame to `out`.
+  void read_frame(uint64_t frame, double *out);
+
+  // Takes effect for blocks filled from now on, the budget right away.
+  void set_options(const ScrollbackOptions &options);
+  const ScrollbackOptions &get_options() const { return options; }
+
+private:
+  struct Block {
+    uint32_t sample_bits;
+    uint32_t compression;
+    float log_min;
+    float log_scale;
+    size_t raw_size;
+    std::vector<uint8_t> data;
+  };
+
+  void seal(const float *logs);
+  void trim();
+  const uint8_t *block_data(size_t block);
+
+  ScrollbackOptions options;
+  size_t num_bins = 0;
+  uint64_t next_frame = 0;
+  size_t frames = 0;
+  // Sealed blocks, oldest first; the frames after them are in `open`.
+  std::deque<Block> blocks;
+  std::vector<float> open;
+  size_t stored_bytes = 0;
+
+  uint64_t cached_block = UINT64_MAX; // first frame of the block in `cache`
+  std::vector<uint8_t> cache;
+};
+
+#endif
@@ -1,9 +1,22 @@
 #include "shader_utils.h"
 #include "gl.h"
+#include <SDL.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <vector>
+
+static const char *SHADER_PREFIX = "#version 120\n"
+                                   "#define lowp   \n"
+                                   "#define mediump\n"
+                                   "#define highp  \n";
+
+static ProgramCacheStats cache_stats;
 
 std::string error_log(GLuint object) {
   GLint log_length = 0;
@@ -38,14 +51,26 @@ std::string file_read(const char *path) {
                      (std::istreambuf_iterator<char>()));
 }
 
+std::string shader_source(const char *filename) {
+  const char *dir = getenv("AV_SHADER_DIR");
+  if (dir != nullptr) {
+    return file_read((std::filesystem::path(dir) / filename).c_str());
+  }
+  for (const EmbeddedShader *shader = embedded_shaders; shader->name != nullptr;
+       shader++) {
+    if (strcmp(shader->name, filename) == 0) {
+      return shader->source;
+    }
+  }
+  std::stringstream ss;
+  ss << "shader_source: " << filename << " isn't embedded";
+  throw std::runtime_error(ss.str());
+}
+
 GLuint create_shader(const char *filename, GLenum type) {
-  const std::string source = file_read(filename);
+  const std::string source = shader_source(filename);
   GLuint res = glCreateShader(type);
-  const GLchar *sources[] = {"#version 120\n"
-                             "#define lowp   \n"
-                             "#define mediump\n"
-                             "#define highp  \n",
-                             source.data()};
+  const GLchar *sources[] = {SHADER_PREFIX, source.data()};
   glShaderSource(res, 2, sources, NULL);
 
   glCompileShader(res);
@@ -59,7 +84,132 @@ GLuint create_shader(const char *filename, GLenum type) {
   return res;
 }
 
+// FNV-1a, only used to name cache files.
+static uint64_t fnv1a(const std::string &data, uint64_t hash = 14695981039346656037ull) {
+  for (unsigned char c : data) {
+    hash = (hash ^ c) * 1099511628211ull;
+  }
+  return hash;
+}
+
+static std::string hex(uint64_t value) {
+  char buffer[17];
+  snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)value);
+  return buffer;
+}
+
+static std::string gl_string(GLenum name) {
+  const GLubyte *value = glGetString(name);
+  return value != nullptr ? (const char *)value : "";
+}
+
+// Empty when the driver can't hand out program binaries.
+static std::filesystem::path program_cache_dir() {
+  GLint formats = 0;
+  if (GLAD_GL_VERSION_4_1) {
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  }
+  if (formats <= 0) {
+    return {};
+  }
+
+  std::filesystem::path base;
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  if (xdg != nullptr && xdg[0] != '\0') {
+    base = xdg;
+  } else if (home != nullptr) {
+    base = std::filesystem::path(home) / ".cache";
+  } else {
+    return {};
+  }
+  // Binaries are only valid for the driver that made them.
+  std::string driver = gl_string(GL_VENDOR) + '\n' + gl_string(GL_RENDERER) +
+                       '\n' + gl_string(GL_VERSION);
+  return base / "audio-visualizer" / hex(fnv1a(driver));
+}
+
+static bool linked(GLuint program) {
+  GLint link_ok = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+  return link_ok == GL_TRUE;
+}
+
+// Cache file layout: GLenum binary format, then the binary.
+static GLuint load_program_binary(const std::filesystem::path &path) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (ifs.fail()) {
+    return 0;
+  }
+  GLenum format;
+  std::vector<char> binary((std::istreambuf_iterator<char>(ifs)),
+                           std::istreambuf_iterator<char>());
+  if (binary.size() <= sizeof(format)) {
+    return 0;
+  }
+  memcpy(&format, binary.data(), sizeof(format));
+
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, format, binary.data() + sizeof(format),
+                  binary.size() - sizeof(format));
+  // Drivers reject binaries they no longer like (e.g. after an update that
+  // kept the version string), then it is compiled again.
+  if (!linked(program)) {
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+static void save_program_binary(GLuint program,
+                                const std::filesystem::path &path) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+  GLenum format;
+  std::vector<char> binary(sizeof(format) + length);
+  glGetProgramBinary(program, length, nullptr, &format,
+                     binary.data() + sizeof(format));
+  memcpy(binary.data(), &format, sizeof(format));
+
+  // The cache is only an optimization, failing to write it isn't an error.
+  // Written aside and renamed so that a crash never leaves half a file.
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+  std::filesystem::path temporary = path;
+  temporary += ".tmp";
+  std::ofstream ofs(temporary, std::ios::binary);
+  ofs.write(binary.data(), binary.size());
+  ofs.close();
+  if (ofs.fail()) {
+    std::filesystem::remove(temporary, ec);
+    return;
+  }
+  std::filesystem::rename(temporary, path, ec);
+}
+
 GLuint create_program(const char *vertexfile, const char *fragmentfile) {
+  Uint64 start = SDL_GetPerformanceCounter();
+  cache_stats.programs++;
+
+  static std::filesystem::path cache_dir = program_cache_dir();
+  std::filesystem::path cache_file;
+  if (!cache_dir.empty()) {
+    uint64_t key = fnv1a(SHADER_PREFIX);
+    key = fnv1a(vertexfile ? shader_source(vertexfile) : "", key);
+    key = fnv1a(fragmentfile ? shader_source(fragmentfile) : "", key);
+    cache_file = cache_dir / (hex(key) + ".bin");
+    GLuint program = load_program_binary(cache_file);
+    if (program != 0) {
+      cache_stats.from_cache++;
+      cache_stats.ms += 1000.0 * (SDL_GetPerformanceCounter() - start) /
+                        SDL_GetPerformanceFrequency();
+      return program;
+    }
+  }
+
   GLuint program = glCreateProgram();
   GLuint shader;
 
@@ -73,17 +223,25 @@ GLuint create_program(const char *vertexfile, const char *fragmentfile) {
     glAttachShader(program, shader);
   }
 
+  if (!cache_file.empty()) {
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
   glLinkProgram(program);
-  GLint link_ok = GL_FALSE;
-  glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
-  if (!link_ok) {
+  if (!linked(program)) {
     std::stringstream ss;
     ss << "glLinkProgram: (" << vertexfile << ", " << fragmentfile << ")";
     throw std::runtime_error(ss.str());
   }
+  if (!cache_file.empty()) {
+    save_program_binary(program, cache_file);
+  }
+  cache_stats.ms += 1000.0 * (SDL_GetPerformanceCounter() - start) /
+                    SDL_GetPerformanceFrequency();
   return program;
 }
 
+const ProgramCacheStats &program_cache_stats() { return cache_stats; }
+
 GLint get_attrib(GLuint program, const char *name) {
   GLint attribute = glGetAttribLocation(program, name);
   if (attribute == -1) {
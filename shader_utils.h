@@ -4,12 +4,37 @@
 #include "gl.h"
 #include <string>
 
+// GLSL sources compiled into the binary, see the shaders.gen.cpp rule in the
+// Makefile. Terminated by a {nullptr, nullptr} entry.
+struct EmbeddedShader {
+  const char *name;
+  const char *source;
+};
+extern const EmbeddedShader embedded_shaders[];
+
+struct ProgramCacheStats {
+  int programs = 0;
+  int from_cache = 0;
+  double ms = 0; // spent in create_program()
+};
+
 std::string file_read(const char *path);
 
+// The embedded source of shader `filename`, or the file of that name in
+// $AV_SHADER_DIR when it is set, to try out shader changes without a
+// rebuild.
+std::string shader_source(const char *filename);
+
 GLuint create_shader(const char *filename, GLenum type);
 
+// Links the two shaders, or loads the program from the binary cache when the
+// driver supports glProgramBinary (GL 4.1) and the same sources were linked
+// before by the same driver. Cache files live in
+// $XDG_CACHE_HOME/audio-visualizer/<driver>/ (~/.cache when unset).
 GLuint create_program(const char *vertexfile, const char *fragmentfile);
 
+const ProgramCacheStats &program_cache_stats();
+
 GLint get_attrib(GLuint program, const char *name);
 
 GLint get_uniform(GLuint program, const char *name);
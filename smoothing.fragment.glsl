@@ -0,0 +1,34 @@
+// One texel per bin of the smoothing state:
+//   r  smoothed magnitude
+//   g  peak-hold level
+//   b  analysis frames the peak is still held for
+//   a  speed the peak is falling at
+uniform sampler2D spectrum; // raw magnitudes
+uniform float scale;        // full-scale magnitude, inverted
+uniform sampler2D state;
+uniform float width;
+uniform float attack;  // smoothing coefficients for the elapsed frames
+uniform float release;
+uniform float frames;  // analysis frames since the last update
+uniform float hold;    // frames a new peak is held for
+uniform float gravity; // peak fall acceleration, per frame squared
+
+void main(void) {
+	vec2 uv = vec2(gl_FragCoord.x / width, 0.5);
+	float raw = texture2D(spectrum, uv).r * scale;
+	vec4 s = texture2D(state, uv);
+
+	float smoothed = mix(s.r, raw, raw > s.r ? attack : release);
+	float peak = s.g;
+	float held = s.b - frames;
+	float speed = s.a;
+	if (smoothed >= peak) {
+		peak = smoothed;
+		held = hold;
+		speed = 0.0;
+	} else if (held <= 0.0) {
+		speed += gravity * frames;
+		peak = max(smoothed, peak - speed * frames);
+	}
+	gl_FragColor = vec4(smoothed, peak, max(held, 0.0), speed);
+}
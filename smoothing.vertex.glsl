@@ -0,0 +1,5 @@
+attribute vec2 corner;
+
+void main(void) {
+	gl_Position = vec4(corner, 0, 1);
+}
@@ -1,11 +1,15 @@
 #include "spectrogram.h"
 #include "SDL_audio.h"
 #include "fft.h"
+#include "frame_arena.h"
 #include "gl.h"
 #include "global.h"
 #include "plot_utils.h"
 #include "shader_utils.h"
 #include <SDL_opengl.h>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
 #include <limits>
 #include <mutex>
 #include <stdexcept>
@@ -20,71 +24,408 @@ static const char *FFT_VERTEX_SHADER = "fft.vertex.glsl";
 static const char *WAVE_VERTEX_SHADER = "wave.vertex.glsl";
 static const char *FFT_FRAGMENT_SHADER = "fft.fragment.glsl";
 static const char *WAVE_FRAGMENT_SHADER = "wave.fragment.glsl";
+static const char *SMOOTHING_VERTEX_SHADER = "smoothing.vertex.glsl";
+static const char *SMOOTHING_FRAGMENT_SHADER = "smoothing.fragment.glsl";
+static const char *SMOOTHED_VERTEX_SHADER = "fft_smoothed.vertex.glsl";
+static const char *BARS_VERTEX_SHADER = "bars.vertex.glsl";
+static const char *BARS_FRAGMENT_SHADER = "bars.fragment.glsl";
 
+// Share of the space between bars they fill.
+static const float BAR_FILL = 0.8;
+// Bar colors from bottom to top, the same as the FFT line.
+static const GradientStop GRADIENT_STOPS[] = {{0.0, {0.0, 1.0, 0.0}},
+                                              {0.2, {1.0, 1.0, 0.5}},
+                                              {0.3, {1.0, 0.25, 0.125}},
+                                              {1.0, {1.0, 0.0, 0.0}}};
+// Two triangles per bar.
+static const point BAR_CORNERS[6] = {{0, 0}, {1, 0}, {0, 1},
+                                     {0, 1}, {1, 0}, {1, 1}};
+
+// Peak-hold markers fall with this acceleration, in full scale per analysis
+// frame squared: a full-scale peak drops to nothing in about 1 s.
+static const float PEAK_GRAVITY = 2.0 / (TARGET_FPS * TARGET_FPS);
+
+// The graphs take x from the vertex index and scale the raw values in the
+// vertex shader, so every frame only uploads one float per vertex.
 static GLuint fft_program;
+static GLint fft_attr_index;
+static GLint fft_attr_magnitude;
+static GLint fft_uniform_last;
+static GLint fft_uniform_scale;
 static GLuint wave_program;
-static GLint fft_attr_coord2d;
-static GLint wave_attr_coord2d;
+static GLint wave_attr_index;
+static GLint wave_attr_sample;
+static GLint wave_uniform_last;
+static GLint wave_uniform_scale;
+static GLint wave_uniform_offset;
 static GLuint vbo;
+// 0, 1, 2, ... for the index attributes, grown as needed.
+static GLuint index_vbo;
+static size_t index_n = 0;
+
+static GLuint smoothing_program;
+static GLint smoothing_attr_corner;
+static GLint smoothing_uniform_spectrum;
+static GLint smoothing_uniform_scale;
+static GLint smoothing_uniform_state;
+static GLint smoothing_uniform_width;
+static GLint smoothing_uniform_attack;
+static GLint smoothing_uniform_release;
+static GLint smoothing_uniform_frames;
+static GLint smoothing_uniform_hold;
+static GLint smoothing_uniform_gravity;
+static GLuint smoothed_program;
+static GLint smoothed_attr_index;
+static GLint smoothed_uniform_bins;
+static GLint smoothed_uniform_state;
+static GLint smoothed_uniform_peaks;
+
+struct bar {
+  GLfloat left;
+  GLfloat right;
+  GLfloat u;
+};
+
+static GLuint bars_program;
+static GLint bars_attr_corner;
+static GLint bars_attr_bar;
+static GLint bars_attr_height;
+static GLint bars_uniform_state;
+static GLint bars_uniform_smoothed;
+static GLint bars_uniform_scale;
+static GLint bars_uniform_gradient;
+// Without instanced arrays (GL 3.3) every bar gets its six vertices.
+static bool instancing;
+static GLuint bar_corner_vbo;
+static GLuint bar_vbo;
+static GLuint bar_height_vbo;
+static GLuint bars_gradient;
+// What bar_vbo was built for.
+static size_t bars_n = 0;
+
+static GLuint quad_vbo;
+static GLuint spectrum_texture; // newest spectrum, one R32F texel per bin
+static GLuint state_textures[2];
+static GLuint state_fbos[2];
+static int state_current = 0;
+static size_t state_width = 0;
+static uint64_t state_frame_id = 0;
 
 void spectrogramInit() {
   fft_program = create_program(FFT_VERTEX_SHADER, FFT_FRAGMENT_SHADER);
-  fft_attr_coord2d = get_attrib(fft_program, "coord2d");
+  fft_attr_index = get_attrib(fft_program, "index");
+  fft_attr_magnitude = get_attrib(fft_program, "magnitude");
+  fft_uniform_last = get_uniform(fft_program, "last");
+  fft_uniform_scale = get_uniform(fft_program, "scale");
 
   wave_program = create_program(WAVE_VERTEX_SHADER, WAVE_FRAGMENT_SHADER);
-  wave_attr_coord2d = get_attrib(wave_program, "coord2d");
+  wave_attr_index = get_attrib(wave_program, "index");
+  wave_attr_sample = get_attrib(wave_program, "sample");
+  wave_uniform_last = get_uniform(wave_program, "last");
+  wave_uniform_scale = get_uniform(wave_program, "scale");
+  wave_uniform_offset = get_uniform(wave_program, "offset");
 
   glGenBuffers(1, &vbo);
+  glGenBuffers(1, &index_vbo);
+
+  smoothing_program =
+      create_program(SMOOTHING_VERTEX_SHADER, SMOOTHING_FRAGMENT_SHADER);
+  smoothing_attr_corner = get_attrib(smoothing_program, "corner");
+  smoothing_uniform_spectrum = get_uniform(smoothing_program, "spectrum");
+  smoothing_uniform_scale = get_uniform(smoothing_program, "scale");
+  smoothing_uniform_state = get_uniform(smoothing_program, "state");
+  smoothing_uniform_width = get_uniform(smoothing_program, "width");
+  smoothing_uniform_attack = get_uniform(smoothing_program, "attack");
+  smoothing_uniform_release = get_uniform(smoothing_program, "release");
+  smoothing_uniform_frames = get_uniform(smoothing_program, "frames");
+  smoothing_uniform_hold = get_uniform(smoothing_program, "hold");
+  smoothing_uniform_gravity = get_uniform(smoothing_program, "gravity");
+
+  smoothed_program = create_program(SMOOTHED_VERTEX_SHADER, FFT_FRAGMENT_SHADER);
+  smoothed_attr_index = get_attrib(smoothed_program, "index");
+  smoothed_uniform_bins = get_uniform(smoothed_program, "bins");
+  smoothed_uniform_state = get_uniform(smoothed_program, "state");
+  smoothed_uniform_peaks = get_uniform(smoothed_program, "peaks");
+
+  const point quad[] = {{-1, -1}, {1, -1}, {-1, 1}, {1, 1}};
+  glGenBuffers(1, &quad_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+
+  glGenTextures(1, &spectrum_texture);
+  glGenTextures(2, state_textures);
+  glGenFramebuffers(2, state_fbos);
+
+  bars_program = create_program(BARS_VERTEX_SHADER, BARS_FRAGMENT_SHADER);
+  bars_attr_corner = get_attrib(bars_program, "corner");
+  bars_attr_bar = get_attrib(bars_program, "bar");
+  bars_attr_height = get_attrib(bars_program, "height");
+  bars_uniform_state = get_uniform(bars_program, "state");
+  bars_uniform_smoothed = get_uniform(bars_program, "smoothed");
+  bars_uniform_scale = get_uniform(bars_program, "scale");
+  bars_uniform_gradient = get_uniform(bars_program, "gradient");
+  instancing = GLAD_GL_VERSION_3_3;
+  glGenBuffers(1, &bar_corner_vbo);
+  glGenBuffers(1, &bar_vbo);
+  glGenBuffers(1, &bar_height_vbo);
+  if (instancing) {
+    glBindBuffer(GL_ARRAY_BUFFER, bar_corner_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(BAR_CORNERS), BAR_CORNERS,
+                 GL_STATIC_DRAW);
+  }
+
+  bars_gradient = gradient_texture(GRADIENT_STOPS, std::size(GRADIENT_STOPS));
 }
 
-static void display(std::vector<point> &graph, GLuint program,
-                    GLint attr_coord2d) {
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+static void float_texture(GLuint texture, GLint internal_format,
+                          GLenum format, size_t width) {
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  std::vector<float> zeros(width * 4, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, 1, 0, format,
+               GL_FLOAT, zeros.data());
+}
 
-  glBufferData(GL_ARRAY_BUFFER, sizeof(point) * graph.size(), graph.data(),
-               GL_DYNAMIC_DRAW);
+// (Re)allocates the textures for `width` bins, which also clears the state.
+static void reset_state(size_t width) {
+  float_texture(spectrum_texture, GL_R32F, GL_RED, width);
+  for (int i = 0; i < 2; i++) {
+    float_texture(state_textures[i], GL_RGBA32F, GL_RGBA, width);
+    glBindFramebuffer(GL_FRAMEBUFFER, state_fbos[i]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, state_textures[i], 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      throw std::runtime_error("spectrum smoothing: float framebuffer "
+                               "isn't supported");
+    }
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  state_width = width;
+}
 
-  glUseProgram(program);
+// Advances the smoothing state by the analysis frames since the last call,
+// with `values` as the newest spectrum.
+static void update_state(const float *values, size_t n, uint64_t frameId,
+                         const SpectrumSmoothing &smoothing) {
+  uint64_t frames = frameId - state_frame_id;
+  if (n != state_width || frames > HISTORY_SIZE) {
+    // A new track or a seek, the old state means nothing anymore.
+    reset_state(n);
+    frames = 1;
+  }
+  state_frame_id = frameId;
+  if (frames == 0) {
+    return;
+  }
 
-  glEnableVertexAttribArray(attr_coord2d);
-  glVertexAttribPointer(attr_coord2d, 2, GL_FLOAT, GL_FALSE, 0, 0);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, spectrum_texture);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, n, 1, GL_RED, GL_FLOAT, values);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, state_textures[state_current]);
 
-  glLineWidth(2.5);
-  glDrawArrays(GL_LINE_STRIP, 0, graph.size());
+  // One-pole coefficients for `frames` steps of 1 / TARGET_FPS.
+  double elapsed_ms = 1000.0 * frames / TARGET_FPS;
+  auto coefficient = [elapsed_ms](float time_constant_ms) {
+    return time_constant_ms > 0 ? 1 - exp(-elapsed_ms / time_constant_ms) : 1;
+  };
+
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+  glDisable(GL_SCISSOR_TEST);
+  state_current = 1 - state_current;
+  glBindFramebuffer(GL_FRAMEBUFFER, state_fbos[state_current]);
+  glViewport(0, 0, n, 1);
+  // The alpha channel is state, not coverage.
+  glDisable(GL_BLEND);
+
+  glUseProgram(smoothing_program);
+  glUniform1i(smoothing_uniform_spectrum, 0);
+  glUniform1f(smoothing_uniform_scale, 1.0 / MAX_FFT_OUTPUT);
+  glUniform1i(smoothing_uniform_state, 1);
+  glUniform1f(smoothing_uniform_width, n);
+  glUniform1f(smoothing_uniform_attack, coefficient(smoothing.attack_ms));
+  glUniform1f(smoothing_uniform_release, coefficient(smoothing.release_ms));
+  glUniform1f(smoothing_uniform_frames, frames);
+  glUniform1f(smoothing_uniform_hold, smoothing.hold_ms * TARGET_FPS / 1000);
+  glUniform1f(smoothing_uniform_gravity, PEAK_GRAVITY);
+  glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+  glEnableVertexAttribArray(smoothing_attr_corner);
+  glVertexAttribPointer(smoothing_attr_corner, 2, GL_FLOAT, GL_FALSE, 0, 0);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  glDisableVertexAttribArray(smoothing_attr_corner);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  if (scissor) {
+    glEnable(GL_SCISSOR_TEST);
+  }
+  glActiveTexture(GL_TEXTURE0);
 }
 
-static std::vector<point> fftGraph(double *labels, double *values, size_t n) {
-  std::vector<point> graph(n);
-  double labelSpan = span(labels, n);
-  for (size_t i = 0; i < n; i++) {
-    graph[i].x = 2 * (labels[i] / labelSpan - 0.5);
-    graph[i].y = values[i] / MAX_FFT_OUTPUT;
+// Binds 0 ... n - 1 to `attr`.
+static void bind_indices(GLint attr, size_t n) {
+  glBindBuffer(GL_ARRAY_BUFFER, index_vbo);
+  if (n > index_n) {
+    float *indices = frame_arena.alloc<float>(n);
+    for (size_t i = 0; i < n; i++) {
+      indices[i] = i;
+    }
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * n, indices, GL_STATIC_DRAW);
+    index_n = n;
   }
-  return graph;
+  glEnableVertexAttribArray(attr);
+  glVertexAttribPointer(attr, 1, GL_FLOAT, GL_FALSE, 0, 0);
 }
 
-static std::vector<point> waveGraph(double *labels, double *values, size_t n,
-                                    SDL_AudioFormat format) {
-  std::vector<point> graph(n);
-  double labelSpan = span(labels, n);
-  for (size_t i = 0; i < n; i++) {
-    graph[i].x = 2 * (labels[i] / labelSpan - 0.5);
+// The smoothed line (unless only the peaks are wanted) and the peak markers,
+// both read from the state texture in the vertex shader.
+static void display_smoothed(size_t n, bool line) {
+  glUseProgram(smoothed_program);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, state_textures[state_current]);
+  glUniform1i(smoothed_uniform_state, 0);
+  glUniform1f(smoothed_uniform_bins, n);
+  bind_indices(smoothed_attr_index, n);
 
-    double scaledY = scaleY(values[i], format);
+  if (line) {
+    glUniform1f(smoothed_uniform_peaks, 0);
+    glLineWidth(2.5);
+    glDrawArrays(GL_LINE_STRIP, 0, n);
+  }
+  glUniform1f(smoothed_uniform_peaks, 1);
+  glPointSize(3);
+  glDrawArrays(GL_POINTS, 0, n);
+  glDisableVertexAttribArray(smoothed_attr_index);
+}
+
+// The program is set up by the caller.
+static void display(const float *values, size_t n, GLint attr_index,
+                    GLint attr_value) {
+  bind_indices(attr_index, n);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(float) * n, values, GL_STREAM_DRAW);
+  glEnableVertexAttribArray(attr_value);
+  glVertexAttribPointer(attr_value, 1, GL_FLOAT, GL_FALSE, 0, 0);
+
+  glLineWidth(2.5);
+  glDrawArrays(GL_LINE_STRIP, 0, n);
+  glDisableVertexAttribArray(attr_index);
+  glDisableVertexAttribArray(attr_value);
+}
 
-    graph[i].y = scaledY / 4 - 0.5;
+// One quad per bin. Instanced, the only per-frame upload are the n heights
+// (none when they come from the smoothing state).
+static void display_bars(const float *values, size_t n, bool smoothed) {
+  size_t copies = instancing ? 1 : 6;
+  if (n != bars_n) {
+    double step = n > 1 ? 2.0 / (n - 1) : 2.0;
+    bar *bars = frame_arena.alloc<bar>(n * copies);
+    for (size_t i = 0; i < n; i++) {
+      float center = i * step - 1;
+      for (size_t c = 0; c < copies; c++) {
+        bars[i * copies + c] =
+            bar{(GLfloat)(center - 0.5 * BAR_FILL * step),
+                (GLfloat)(center + 0.5 * BAR_FILL * step), (i + 0.5f) / n};
+      }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, bar_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(bar) * n * copies, bars,
+                 GL_STATIC_DRAW);
+    if (!instancing) {
+      point *corners = frame_arena.alloc<point>(n * 6);
+      for (size_t i = 0; i < n * 6; i++) {
+        corners[i] = BAR_CORNERS[i % 6];
+      }
+      glBindBuffer(GL_ARRAY_BUFFER, bar_corner_vbo);
+      glBufferData(GL_ARRAY_BUFFER, sizeof(point) * n * 6, corners,
+                   GL_STATIC_DRAW);
+    }
+    bars_n = n;
   }
-  return graph;
+
+  glUseProgram(bars_program);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, state_textures[state_current]);
+  glUniform1i(bars_uniform_state, 0);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, bars_gradient);
+  glUniform1i(bars_uniform_gradient, 1);
+  glActiveTexture(GL_TEXTURE0);
+  glUniform1f(bars_uniform_smoothed, smoothed);
+  glUniform1f(bars_uniform_scale, 1.0 / MAX_FFT_OUTPUT);
+
+  glBindBuffer(GL_ARRAY_BUFFER, bar_corner_vbo);
+  glEnableVertexAttribArray(bars_attr_corner);
+  glVertexAttribPointer(bars_attr_corner, 2, GL_FLOAT, GL_FALSE, 0, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, bar_vbo);
+  glEnableVertexAttribArray(bars_attr_bar);
+  glVertexAttribPointer(bars_attr_bar, 3, GL_FLOAT, GL_FALSE, 0, 0);
+  if (smoothed) {
+    glVertexAttrib1f(bars_attr_height, 0);
+  } else {
+    // Instanced, the spectrum goes up as it is.
+    const float *heights = values;
+    if (copies != 1) {
+      float *copied = frame_arena.alloc<float>(n * copies);
+      for (size_t i = 0; i < n * copies; i++) {
+        copied[i] = values[i / copies];
+      }
+      heights = copied;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, bar_height_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * n * copies, heights,
+                 GL_STREAM_DRAW);
+    glEnableVertexAttribArray(bars_attr_height);
+    glVertexAttribPointer(bars_attr_height, 1, GL_FLOAT, GL_FALSE, 0, 0);
+  }
+
+  if (instancing) {
+    glVertexAttribDivisor(bars_attr_bar, 1);
+    glVertexAttribDivisor(bars_attr_height, 1);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, n);
+    glVertexAttribDivisor(bars_attr_bar, 0);
+    glVertexAttribDivisor(bars_attr_height, 0);
+  } else {
+    glDrawArrays(GL_TRIANGLES, 0, n * 6);
+  }
+  glDisableVertexAttribArray(bars_attr_corner);
+  glDisableVertexAttribArray(bars_attr_bar);
+  glDisableVertexAttribArray(bars_attr_height);
 }
 
-void spectrogramDisplay(double *fftLabels, double *fftValues, size_t fftN,
-                        double *waveLabels, double *waveValues, size_t waveN,
-                        SDL_AudioFormat format) {
-  std::vector<point> fftData = fftGraph(fftLabels, fftValues, fftN);
-  display(fftData, fft_program, fft_attr_coord2d);
-
-  std::vector<point> waveGraphData =
-      waveGraph(waveLabels, waveValues, waveN, format);
-  big_lock.unlock();
-  display(waveGraphData, wave_program, wave_attr_coord2d);
-}
\ No newline at end of file
+void spectrogramDisplaySpectrum(const float *values, size_t n, uint64_t frameId,
+                                const SpectrumSmoothing &smoothing, bool bars) {
+  bool smoothed = smoothing.enabled && n != 0;
+  if (smoothed) {
+    update_state(values, n, frameId, smoothing);
+  }
+  if (bars && n != 0) {
+    display_bars(values, n, smoothed);
+    if (smoothed) {
+      display_smoothed(n, false);
+    }
+  } else if (smoothed) {
+    display_smoothed(n, true);
+  } else {
+    glUseProgram(fft_program);
+    glUniform1f(fft_uniform_last, std::max<size_t>(n, 2) - 1);
+    glUniform1f(fft_uniform_scale, 1.0 / MAX_FFT_OUTPUT);
+    display(values, n, fft_attr_index, fft_attr_magnitude);
+  }
+}
+
+void spectrogramDisplayWave(const float *values, size_t n,
+                            SDL_AudioFormat format) {
+  // scaleY() is linear in the sample value.
+  double offset = scaleY(0, format);
+  glUseProgram(wave_program);
+  glUniform1f(wave_uniform_last, std::max<size_t>(n, 2) - 1);
+  glUniform1f(wave_uniform_scale, scaleY(1, format) - offset);
+  glUniform1f(wave_uniform_offset, offset);
+  display(values, n, wave_attr_index, wave_attr_sample);
+}
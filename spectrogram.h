@@ -3,12 +3,32 @@
 
 #include <SDL_audio.h>
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
+// Attack/release smoothing and falling peak-hold of the 2D spectrum line.
+// Both run on the GPU in a ping-pong float texture, the CPU only uploads the
+// newest spectrum.
+struct SpectrumSmoothing {
+  bool enabled = true;
+  float attack_ms = 10;
+  float release_ms = 250;
+  float hold_ms = 600;
+};
+
 void spectrogramInit();
 
-void spectrogramDisplay(double *fftLabels, double *fftValues, size_t fftN,
-                        double *waveLabels, double *waveValues, size_t waveN,
-                        SDL_AudioFormat fmt);
+// The spectrum in the upper half of clip space, as a line or, with `bars`,
+// as a bar graph, bins spread evenly across the viewport. `values` are raw
+// magnitudes, they are uploaded as they are and scaled by the shaders.
+// frameId is plot_frame_id of `values`, the smoothing state advances once
+// per new analysis frame.
+void spectrogramDisplaySpectrum(const float *values, size_t n, uint64_t frameId,
+                                const SpectrumSmoothing &smoothing, bool bars);
+
+// The newest block of samples, in the units of `format`, across the whole
+// viewport.
+void spectrogramDisplayWave(const float *values, size_t n,
+                            SDL_AudioFormat format);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,327 @@
+#include "spectrum_store.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef AV_WITH_ZSTD
+#include <zstd.h>
+#endif
+#ifdef AV_WITH_LZ4
+#include <lz4.h>
+#endif
+
+static const char STORE_MAGIC[4] = {'A', 'V', 'S', 'G'};
+
+static uint32_t quantization_max(uint32_t sample_bits) {
+  return sample_bits == 16 ? UINT16_MAX : UINT8_MAX;
+}
+
+bool store_compression_supported(uint32_t compression) {
+  switch (compression) {
+  case STORE_RAW:
+    return true;
+#ifdef AV_WITH_ZSTD
+  case STORE_ZSTD:
+    return true;
+#endif
+#ifdef AV_WITH_LZ4
+  case STORE_LZ4:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+std::vector<uint8_t> compress_chunk(const std::vector<uint8_t> &raw,
+                                    uint32_t compression) {
+  switch (compression) {
+  case STORE_RAW:
+    return raw;
+#ifdef AV_WITH_ZSTD
+  case STORE_ZSTD: {
+    std::vector<uint8_t> out(ZSTD_compressBound(raw.size()));
+    size_t n = ZSTD_compress(out.data(), out.size(), raw.data(), raw.size(), 3);
+    if (ZSTD_isError(n)) {
+      throw std::runtime_error(ZSTD_getErrorName(n));
+    }
+    out.resize(n);
+    return out;
+  }
+#endif
+#ifdef AV_WITH_LZ4
+  case STORE_LZ4: {
+    std::vector<uint8_t> out(LZ4_compressBound(raw.size()));
+    int n = LZ4_compress_default((const char *)raw.data(), (char *)out.data(),
+                                 raw.size(), out.size());
+    if (n <= 0) {
+      throw std::runtime_error("LZ4_compress_default failed");
+    }
+    out.resize(n);
+    return out;
+  }
+#endif
+  default:
+    std::stringstream ss;
+    ss << "spectrum store: compression " << compression
+       << " not compiled in";
+    throw std::runtime_error(ss.str());
+  }
+}
+
+void decompress_chunk(const uint8_t *stored, size_t stored_size,
+                      size_t raw_size, uint32_t compression, uint8_t *out) {
+  switch (compression) {
+#ifdef AV_WITH_ZSTD
+  case STORE_ZSTD: {
+    size_t n = ZSTD_decompress(out, raw_size, stored, stored_size);
+    if (ZSTD_isError(n) || n != raw_size) {
+      throw std::runtime_error("spectrum store: corrupted zstd chunk");
+    }
+    return;
+  }
+#endif
+#ifdef AV_WITH_LZ4
+  case STORE_LZ4: {
+    int n = LZ4_decompress_safe((const char *)stored, (char *)out,
+                                stored_size, raw_size);
+    if (n < 0 || (size_t)n != raw_size) {
+      throw std::runtime_error("spectrum store: corrupted lz4 chunk");
+    }
+    return;
+  }
+#endif
+  default:
+    throw std::runtime_error("spectrum store: unsupported compression");
+  }
+}
+
+void quantize_log_magnitudes(const float *log_magnitudes, size_t n,
+                             uint32_t sample_bits, uint8_t *out,
+                             float &log_min, float &log_scale) {
+  float lo = INFINITY, hi = -INFINITY;
+  for (size_t i = 0; i < n; i++) {
+    lo = std::min(lo, log_magnitudes[i]);
+    hi = std::max(hi, log_magnitudes[i]);
+  }
+  if (n == 0) {
+    lo = hi = 0;
+  }
+
+  uint32_t qmax = quantization_max(sample_bits);
+  log_min = lo;
+  log_scale = (hi - lo) / qmax;
+  float inverse = log_scale > 0 ? 1 / log_scale : 0;
+
+  if (sample_bits == 16) {
+    uint16_t *out16 = reinterpret_cast<uint16_t *>(out);
+    for (size_t i = 0; i < n; i++) {
+      out16[i] = std::lround((log_magnitudes[i] - lo) * inverse);
+    }
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      out[i] = std::lround((log_magnitudes[i] - lo) * inverse);
+    }
+  }
+}
+
+void write_spectrum_store(const std::string &path, const float *magnitudes,
+                          size_t frames, size_t bins, uint32_t frame_rate,
+                          uint32_t sample_rate, const StoreOptions &options) {
+  if (options.sample_bits != 8 && options.sample_bits != 16) {
+    throw std::runtime_error("spectrum store: sample_bits must be 8 or 16");
+  }
+  if (!store_compression_supported(options.compression)) {
+    compress_chunk({}, options.compression); // Throws with a proper message.
+  }
+
+  std::ofstream ofs(path, std::ios::binary);
+  if (ofs.fail()) {
+    std::stringstream ss;
+    ss << "couldn't open " << path << " for writing";
+    throw std::runtime_error(ss.str());
+  }
+
+  StoreHeader header = {};
+  memcpy(header.magic, STORE_MAGIC, sizeof header.magic);
+  header.version = STORE_VERSION;
+  header.bins = bins;
+  header.frames = frames;
+  header.frames_per_chunk = std::max<uint32_t>(options.frames_per_chunk, 1);
+  header.sample_bits = options.sample_bits;
+  header.compression = options.compression;
+  header.frame_rate = frame_rate;
+  header.sample_rate = sample_rate;
+  header.chunk_count =
+      (frames + header.frames_per_chunk - 1) / header.frames_per_chunk;
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof header);
+
+  std::vector<StoreChunk> index(header.chunk_count);
+  std::vector<float> logs;
+  std::vector<uint8_t> raw;
+  uint64_t offset = sizeof header;
+  for (size_t c = 0; c < header.chunk_count; c++) {
+    size_t first = c * header.frames_per_chunk;
+    size_t count = std::min<size_t>(header.frames_per_chunk, frames - first);
+    size_t n = count * bins;
+
+    logs.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      logs[i] = std::log1p(std::max(magnitudes[first * bins + i], 0.0f));
+    }
+    raw.resize(n * options.sample_bits / 8);
+    quantize_log_magnitudes(logs.data(), n, options.sample_bits, raw.data(),
+                            index[c].log_min, index[c].log_scale);
+
+    std::vector<uint8_t> stored = compress_chunk(raw, options.compression);
+    index[c].offset = offset;
+    index[c].stored_size = stored.size();
+    index[c].raw_size = raw.size();
+    ofs.write(reinterpret_cast<const char *>(stored.data()), stored.size());
+    offset += stored.size();
+
+    static const char padding[8] = {};
+    size_t pad = (8 - offset % 8) % 8;
+    ofs.write(padding, pad);
+    offset += pad;
+  }
+
+  header.index_offset = offset;
+  ofs.write(reinterpret_cast<const char *>(index.data()),
+            sizeof(StoreChunk) * index.size());
+  ofs.seekp(0);
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof header);
+  if (ofs.fail()) {
+    std::stringstream ss;
+    ss << "write to " << path << " failed";
+    throw std::runtime_error(ss.str());
+  }
+}
+
+SpectrumStore::SpectrumStore(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::stringstream ss;
+    ss << "spectrum store: couldn't open " << path;
+    throw std::runtime_error(ss.str());
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(StoreHeader)) {
+    close(fd);
+    std::stringstream ss;
+    ss << "spectrum store: " << path << " is too short";
+    throw std::runtime_error(ss.str());
+  }
+  size = st.st_size;
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    std::stringstream ss;
+    ss << "spectrum store: mmap of " << path << " failed";
+    throw std::runtime_error(ss.str());
+  }
+  data = static_cast<const uint8_t *>(mapping);
+  header = reinterpret_cast<const StoreHeader *>(data);
+
+  const char *problem = nullptr;
+  if (memcmp(header->magic, STORE_MAGIC, sizeof STORE_MAGIC) != 0) {
+    problem = "not a spectrum store";
+  } else if (header->version != STORE_VERSION) {
+    problem = "unsupported version";
+  } else if (header->sample_bits != 8 && header->sample_bits != 16) {
+    problem = "bad sample_bits";
+  } else if (!store_compression_supported(header->compression)) {
+    problem = "compression not compiled in";
+  } else if (header->bins == 0 || header->frames_per_chunk == 0) {
+    problem = "empty frames";
+  } else if (header->index_offset < sizeof(StoreHeader) ||
+             header->index_offset > size ||
+             header->chunk_count >
+                 (size - header->index_offset) / sizeof(StoreChunk)) {
+    // Every term on its own: a sum or product could wrap around.
+    problem = "truncated index";
+  }
+  if (problem == nullptr) {
+    index = reinterpret_cast<const StoreChunk *>(data + header->index_offset);
+    if ((uint64_t)header->chunk_count * header->frames_per_chunk <
+        header->frames) {
+      problem = "index doesn't cover all frames";
+    }
+    for (size_t c = 0; c < header->chunk_count && problem == nullptr; c++) {
+      size_t rows = std::min<size_t>(header->frames_per_chunk,
+                                     header->frames -
+                                         c * header->frames_per_chunk);
+      if (index[c].offset < sizeof(StoreHeader) ||
+          index[c].offset > header->index_offset ||
+          index[c].stored_size > header->index_offset - index[c].offset) {
+        problem = "truncated chunk";
+      } else if (rows > (uint64_t)index[c].raw_size * 8 / header->sample_bits /
+                            header->bins) {
+        problem = "chunk too small for its frames";
+      } else if (header->compression == STORE_RAW &&
+                 index[c].stored_size != index[c].raw_size) {
+        problem = "raw chunk size mismatch";
+      }
+    }
+  }
+  if (problem != nullptr) {
+    munmap(const_cast<uint8_t *>(data), size);
+    std::stringstream ss;
+    ss << "spectrum store: " << path << ": " << problem;
+    throw std::runtime_error(ss.str());
+  }
+}
+
+SpectrumStore::~SpectrumStore() {
+  munmap(const_cast<uint8_t *>(data), size);
+}
+
+const uint8_t *SpectrumStore::chunk_data(size_t chunk) {
+  if (header->compression == STORE_RAW) {
+    return data + index[chunk].offset;
+  }
+  if (cached_chunk != chunk) {
+    cache.resize(index[chunk].raw_size);
+    decompress_chunk(data + index[chunk].offset, index[chunk].stored_size,
+                     index[chunk].raw_size, header->compression, cache.data());
+    cached_chunk = chunk;
+  }
+  return cache.data();
+}
+
+void SpectrumStore::read_frame(size_t frame, double *out) {
+  if (frame >= header->frames) {
+    throw std::out_of_range("spectrum store: frame out of range");
+  }
+  size_t chunk = frame / header->frames_per_chunk;
+  size_t row = frame % header->frames_per_chunk;
+  float log_min = index[chunk].log_min;
+  float log_scale = index[chunk].log_scale;
+
+  std::lock_guard<std::mutex> guard(cache_lock);
+  const uint8_t *values = chunk_data(chunk);
+  if (header->sample_bits == 16) {
+    const uint16_t *row16 =
+        reinterpret_cast<const uint16_t *>(values) + row * header->bins;
+    for (size_t i = 0; i < header->bins; i++) {
+      out[i] = std::expm1(log_min + log_scale * row16[i]);
+    }
+  } else {
+    const uint8_t *row8 = values + row * header->bins;
+    for (size_t i = 0; i < header->bins; i++) {
+      out[i] = std::expm1(log_min + log_scale * row8[i]);
+    }
+  }
+}
+
+std::vector<double> SpectrumStore::frame(size_t frame) {
+  std::vector<double> result(bins());
+  read_frame(frame, result.data());
+  return result;
+}
@@ -0,0 +1,114 @@
+#ifndef _AUDIO_VISUALIZER_SPECTRUM_STORE_H_
+#define _AUDIO_VISUALIZER_SPECTRUM_STORE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// On-disk spectrogram (.avs), little-endian:
+//
+//   StoreHeader
+//   chunk data, each chunk 8-byte aligned
+//   StoreChunk index[chunk_count]   (at header.index_offset)
+//
+// A chunk holds frames_per_chunk frames (the last one may hold fewer) of
+// `bins` log1p-magnitudes quantized to 8 or 16 bits against the chunk's own
+// [log_min, log_min + log_scale * QMAX] range. Frame k lives in chunk
+// k / frames_per_chunk, so seeking is one index lookup.
+
+// 2: channels are averaged into the mono signal rather than summed.
+const uint32_t STORE_VERSION = 2;
+
+enum StoreCompression : uint32_t {
+  STORE_RAW = 0,
+  STORE_ZSTD = 1,
+  STORE_LZ4 = 2,
+};
+
+struct StoreHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t bins;
+  uint32_t frames;
+  uint32_t frames_per_chunk;
+  uint32_t sample_bits;
+  uint32_t compression;
+  uint32_t frame_rate;
+  uint32_t sample_rate;
+  uint32_t chunk_count;
+  uint64_t index_offset;
+  uint8_t reserved[16];
+};
+static_assert(sizeof(StoreHeader) == 64, "StoreHeader layout");
+
+struct StoreChunk {
+  uint64_t offset;
+  uint32_t stored_size;
+  uint32_t raw_size;
+  float log_min;
+  float log_scale;
+};
+static_assert(sizeof(StoreChunk) == 24, "StoreChunk layout");
+
+struct StoreOptions {
+  uint32_t sample_bits = 8;
+  uint32_t compression = STORE_RAW;
+  uint32_t frames_per_chunk = 64;
+};
+
+// `magnitudes` is frames x bins, row-major.
+void write_spectrum_store(const std::string &path, const float *magnitudes,
+                          size_t frames, size_t bins, uint32_t frame_rate,
+                          uint32_t sample_rate, const StoreOptions &options);
+
+bool store_compression_supported(uint32_t compression);
+
+// `compression` is a StoreCompression, compress_chunk() throws when it isn't
+// compiled in. decompress_chunk() writes exactly raw_size bytes to `out`.
+std::vector<uint8_t> compress_chunk(const std::vector<uint8_t> &raw,
+                                    uint32_t compression);
+void decompress_chunk(const uint8_t *stored, size_t stored_size,
+                      size_t raw_size, uint32_t compression, uint8_t *out);
+
+// Quantizes `n` log-magnitudes into `out` (n bytes or n uint16s depending on
+// `sample_bits`) and returns the range needed to undo it.
+void quantize_log_magnitudes(const float *log_magnitudes, size_t n,
+                             uint32_t sample_bits, uint8_t *out,
+                             float &log_min, float &log_scale);
+
+// Memory-mapped reader. Uncompressed stores are read straight from the
+// mapping; compressed ones decode one chunk at a time and keep it cached.
+class SpectrumStore {
+public:
+  explicit SpectrumStore(const std::string &path);
+  ~SpectrumStore();
+
+  SpectrumStore(const SpectrumStore &) = delete;
+  SpectrumStore &operator=(const SpectrumStore &) = delete;
+
+  size_t frames() const { return header->frames; }
+  size_t bins() const { return header->bins; }
+  uint32_t frame_rate() const { return header->frame_rate; }
+  uint32_t sample_rate() const { return header->sample_rate; }
+
+  // Writes bins() magnitudes of `frame` to `out`.
+  void read_frame(size_t frame, double *out);
+
+  std::vector<double> frame(size_t frame);
+
+private:
+  const uint8_t *chunk_data(size_t chunk);
+
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+  const StoreHeader *header = nullptr;
+  const StoreChunk *index = nullptr;
+
+  std::mutex cache_lock;
+  size_t cached_chunk = SIZE_MAX;
+  std::vector<uint8_t> cache;
+};
+
+#endif
@@ -0,0 +1,328 @@
+#include "stream.h"
+#include "converter.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char PCM_RING_MAGIC[4] = {'A', 'V', 'P', 'R'};
+
+static std::runtime_error system_error(const std::string &what) {
+  std::stringstream ss;
+  ss << what << ": " << strerror(errno);
+  return std::runtime_error(ss.str());
+}
+
+// The formats parse_pcm_spec() knows, the only ones frame_bytes() is
+// non-zero for.
+static bool supported_format(uint32_t format) {
+  return format == AUDIO_U8 || format == AUDIO_S8 || format == AUDIO_U16 ||
+         format == AUDIO_S16 || format == AUDIO_S32;
+}
+
+uint64_t monotonic_ns() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void PcmRing::init_header(SDL_AudioFormat format, int channels, long rate,
+                          size_t capacity) {
+  header = new (memory) PcmRingHeader();
+  memcpy(header->magic, PCM_RING_MAGIC, sizeof(PCM_RING_MAGIC));
+  header->version = PCM_RING_VERSION;
+  header->format = format;
+  header->channels = channels;
+  header->rate = rate;
+  header->capacity = capacity;
+  header->write_pos = 0;
+  header->write_time_ns = monotonic_ns();
+  header->closed = 0;
+  header->read_pos = 0;
+  data = memory + PCM_RING_HEADER_SIZE;
+}
+
+PcmRing::PcmRing(SDL_AudioFormat format, int channels, long rate,
+                 size_t capacity) {
+  size_t frame = sample_byte_size(format) * channels;
+  capacity -= capacity % frame;
+  mapped_size = PCM_RING_HEADER_SIZE + capacity;
+  // aligned_alloc wants a multiple of the alignment.
+  memory = static_cast<uint8_t *>(
+      std::aligned_alloc(64, (mapped_size + 63) / 64 * 64));
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  heap = true;
+  init_header(format, channels, rate, capacity);
+}
+
+PcmRing::PcmRing(const std::string &name, SDL_AudioFormat format,
+                 int channels, long rate, size_t capacity) {
+  size_t frame = sample_byte_size(format) * channels;
+  capacity -= capacity % frame;
+  mapped_size = PCM_RING_HEADER_SIZE + capacity;
+
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    throw system_error("shm_open(" + name + ")");
+  }
+  if (ftruncate(fd, mapped_size) != 0) {
+    auto error = system_error("ftruncate(" + name + ")");
+    ::close(fd);
+    shm_unlink(name.c_str());
+    throw error;
+  }
+  void *mapping =
+      mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    auto error = system_error("mmap(" + name + ")");
+    shm_unlink(name.c_str());
+    throw error;
+  }
+  memory = static_cast<uint8_t *>(mapping);
+  shm_name = name;
+  init_header(format, channels, rate, capacity);
+}
+
+PcmRing::PcmRing(const std::string &name) {
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    throw system_error("shm_open(" + name + ")");
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    auto error = system_error("fstat(" + name + ")");
+    ::close(fd);
+    throw error;
+  }
+  mapped_size = st.st_size;
+  if (mapped_size < PCM_RING_HEADER_SIZE) {
+    ::close(fd);
+    throw std::runtime_error(name + " is too small to be a PCM ring");
+  }
+  void *mapping =
+      mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    throw system_error("mmap(" + name + ")");
+  }
+  memory = static_cast<uint8_t *>(mapping);
+  header = reinterpret_cast<PcmRingHeader *>(memory);
+  data = memory + PCM_RING_HEADER_SIZE;
+
+  std::stringstream ss;
+  if (memcmp(header->magic, PCM_RING_MAGIC, sizeof(PCM_RING_MAGIC)) != 0) {
+    ss << name << " is not a PCM ring";
+  } else if (header->version != PCM_RING_VERSION) {
+    ss << name << ": unsupported PCM ring version " << header->version;
+  } else if (!supported_format(header->format)) {
+    ss << name << ": unsupported sample format " << header->format;
+  } else if (header->channels < 1 || header->channels > 2 ||
+             header->rate == 0 || header->capacity == 0 ||
+             header->capacity > mapped_size - PCM_RING_HEADER_SIZE ||
+             header->capacity % frame_bytes() != 0) {
+    ss << name << ": inconsistent PCM ring header";
+  }
+  if (!ss.str().empty()) {
+    munmap(memory, mapped_size);
+    throw std::runtime_error(ss.str());
+  }
+}
+
+PcmRing::~PcmRing() {
+  if (heap) {
+    header->~PcmRingHeader();
+    free(memory);
+    return;
+  }
+  munmap(memory, mapped_size);
+  if (!shm_name.empty()) {
+    shm_unlink(shm_name.c_str());
+  }
+}
+
+size_t PcmRing::frame_bytes() const {
+  return sample_byte_size(format()) * channels();
+}
+
+uint8_t *PcmRing::writable(size_t &n) {
+  uint64_t write = header->write_pos.load(std::memory_order_relaxed);
+  uint64_t read = header->read_pos.load(std::memory_order_acquire);
+  size_t offset = write % header->capacity;
+  n = std::min<size_t>(header->capacity - (write - read),
+                       header->capacity - offset);
+  return data + offset;
+}
+
+void PcmRing::commit(size_t n) {
+  uint64_t write = header->write_pos.load(std::memory_order_relaxed);
+  header->write_time_ns.store(monotonic_ns(), std::memory_order_relaxed);
+  header->write_pos.store(write + n, std::memory_order_release);
+}
+
+void PcmRing::close() { header->closed.store(1, std::memory_order_release); }
+
+const uint8_t *PcmRing::readable(size_t &n) const {
+  uint64_t read = header->read_pos.load(std::memory_order_relaxed);
+  uint64_t write = header->write_pos.load(std::memory_order_acquire);
+  size_t offset = read % header->capacity;
+  n = std::min<size_t>(write - read, header->capacity - offset);
+  return data + offset;
+}
+
+void PcmRing::release(size_t n) {
+  uint64_t read = header->read_pos.load(std::memory_order_relaxed);
+  header->read_pos.store(read + n, std::memory_order_release);
+}
+
+size_t PcmRing::read(uint8_t *out, size_t max) {
+  max -= max % frame_bytes();
+  size_t available = buffered();
+  size_t total = std::min(max, available - available % frame_bytes());
+  size_t done = 0;
+  while (done < total) {
+    size_t n;
+    const uint8_t *piece = readable(n);
+    n = std::min(n, total - done);
+    memcpy(out + done, piece, n);
+    release(n);
+    done += n;
+  }
+  return total;
+}
+
+size_t PcmRing::buffered() const {
+  return header->write_pos.load(std::memory_order_acquire) -
+         header->read_pos.load(std::memory_order_relaxed);
+}
+
+double PcmRing::producer_age_ms() const {
+  uint64_t written = header->write_time_ns.load(std::memory_order_relaxed);
+  uint64_t now = monotonic_ns();
+  return now > written ? (now - written) / 1e6 : 0;
+}
+
+FdReader::FdReader(int fd, PcmRing &ring) : fd(fd), ring(ring) {
+  thread = std::thread([this] { run(); });
+}
+
+FdReader::~FdReader() {
+  stopping = true;
+  thread.join();
+  if (fd != STDIN_FILENO) {
+    close(fd);
+  }
+}
+
+size_t FdReader::pending() const {
+  int bytes = 0;
+  if (ioctl(fd, FIONREAD, &bytes) != 0) {
+    return 0;
+  }
+  return bytes;
+}
+
+void FdReader::run() {
+  while (!stopping) {
+    size_t free_bytes;
+    uint8_t *space = ring.writable(free_bytes);
+    if (free_bytes == 0) {
+      // The consumer is behind, leave the rest in the pipe.
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    // Poll with a timeout so that the destructor doesn't wait for input.
+    pollfd readable = {fd, POLLIN, 0};
+    int ready = poll(&readable, 1, 100);
+    if (ready == 0 || (ready < 0 && errno == EINTR)) {
+      continue;
+    }
+    ssize_t got = ready > 0 ? read(fd, space, free_bytes) : -1;
+    if (got > 0) {
+      ring.commit(got);
+    } else if (got == 0 || errno != EINTR) {
+      ring.close();
+      return;
+    }
+  }
+}
+
+bool parse_pcm_spec(const char *spec, SDL_AudioFormat &format, long &rate,
+                    int &channels) {
+  char name[8];
+  if (sscanf(spec, "%7[^:]:%ld:%d", name, &rate, &channels) != 3 ||
+      rate <= 0 || channels < 1 || channels > 2) {
+    return false;
+  }
+  if (strcmp(name, "u8") == 0) {
+    format = AUDIO_U8;
+  } else if (strcmp(name, "s8") == 0) {
+    format = AUDIO_S8;
+  } else if (strcmp(name, "u16") == 0) {
+    format = AUDIO_U16;
+  } else if (strcmp(name, "s16") == 0) {
+    format = AUDIO_S16;
+  } else if (strcmp(name, "s32") == 0) {
+    format = AUDIO_S32;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+int shm_feed(int argc, char **argv) {
+  SDL_AudioFormat format;
+  long rate;
+  int channels;
+  if (argc != 2 || !parse_pcm_spec(argv[1], format, rate, channels)) {
+    std::cerr << "usage: audio-visualizer shm-feed NAME FORMAT:RATE:CHANNELS"
+              << std::endl;
+    return 2;
+  }
+
+  try {
+    // 100 ms of ring keeps the producer no further ahead than that.
+    size_t frame = sample_byte_size(format) * channels;
+    PcmRing ring(argv[0], format, channels, rate, rate * frame / 10);
+    std::cerr << "shm-feed: writing to " << argv[0] << std::endl;
+    while (true) {
+      size_t free_bytes;
+      uint8_t *space = ring.writable(free_bytes);
+      if (free_bytes == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        continue;
+      }
+      ssize_t got = read(STDIN_FILENO, space, free_bytes);
+      if (got > 0) {
+        ring.commit(got);
+      } else if (got == 0 || errno != EINTR) {
+        break;
+      }
+    }
+    ring.close();
+    // Keep the ring around until the reader drained it, or for 2 s when
+    // there is none.
+    for (int i = 0; i < 200 && ring.buffered() != 0; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  } catch (std::exception &e) {
+    std::cerr << "shm-feed: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
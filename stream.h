@@ -0,0 +1,130 @@
+#ifndef _AUDIO_VISUALIZER_STREAM_H_
+#define _AUDIO_VISUALIZER_STREAM_H_
+
+#include <SDL_audio.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// Single-producer single-consumer ring of interleaved PCM, laid out so that
+// it can live in POSIX shared memory (shm_open) and be shared by two
+// processes:
+//
+//   PcmRingHeader   (PCM_RING_HEADER_SIZE bytes)
+//   data[capacity]
+//
+// Positions count bytes since the ring was created and never wrap; byte p
+// lives at data[p % capacity]. The producer writes at write_pos and then
+// publishes it with a release store, the consumer reads up to write_pos and
+// publishes read_pos the same way. Producers can fill the ring in place,
+// nothing is copied on the way in.
+
+const uint32_t PCM_RING_VERSION = 1;
+const size_t PCM_RING_HEADER_SIZE = 256;
+
+struct PcmRingHeader {
+  char magic[4]; // "AVPR"
+  uint32_t version;
+  uint32_t format; // SDL_AudioFormat
+  uint32_t channels;
+  uint32_t rate;
+  uint32_t reserved;
+  uint64_t capacity; // data bytes, a multiple of the sample frame size
+  // Producer side.
+  alignas(64) std::atomic<uint64_t> write_pos;
+  std::atomic<uint64_t> write_time_ns; // CLOCK_MONOTONIC of the last commit
+  std::atomic<uint32_t> closed;        // set once nothing more will come
+  // Consumer side.
+  alignas(64) std::atomic<uint64_t> read_pos;
+};
+
+static_assert(sizeof(PcmRingHeader) <= PCM_RING_HEADER_SIZE,
+              "PcmRingHeader doesn't fit its slot");
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared-memory rings need lock-free 64-bit atomics");
+
+class PcmRing {
+public:
+  // A ring in process memory, for readers inside this process.
+  PcmRing(SDL_AudioFormat format, int channels, long rate, size_t capacity);
+  // Creates the shared-memory ring `name` ("/something") as its producer;
+  // it is unlinked again when this object goes away.
+  PcmRing(const std::string &name, SDL_AudioFormat format, int channels,
+          long rate, size_t capacity);
+  // Attaches to the shared-memory ring `name` as its consumer.
+  explicit PcmRing(const std::string &name);
+  ~PcmRing();
+
+  PcmRing(const PcmRing &) = delete;
+  PcmRing &operator=(const PcmRing &) = delete;
+
+  SDL_AudioFormat format() const { return header->format; }
+  int channels() const { return header->channels; }
+  long rate() const { return header->rate; }
+  size_t frame_bytes() const;
+  double bytes_per_second() const { return rate() * frame_bytes(); }
+
+  // Producer: contiguous free space at the write position, `n` is set to
+  // its size. Fill it, then commit() what was written.
+  uint8_t *writable(size_t &n);
+  void commit(size_t n);
+  void close();
+
+  // Consumer: contiguous data at the read position, `n` is set to its size.
+  // release() what was consumed.
+  const uint8_t *readable(size_t &n) const;
+  void release(size_t n);
+  // Copies whole sample frames, at most max bytes, and releases them.
+  size_t read(uint8_t *out, size_t max);
+  size_t buffered() const;
+  bool closed() const { return header->closed != 0; }
+  // Milliseconds since the producer last committed.
+  double producer_age_ms() const;
+
+private:
+  void init_header(SDL_AudioFormat format, int channels, long rate,
+                   size_t capacity);
+
+  std::string shm_name; // set when this object created a shared ring
+  uint8_t *memory = nullptr;
+  size_t mapped_size = 0;
+  bool heap = false;
+  PcmRingHeader *header = nullptr;
+  uint8_t *data = nullptr;
+};
+
+// Reads raw PCM from a file descriptor (stdin, a FIFO, ...) on a thread
+// into an in-process ring. EOF closes the ring.
+class FdReader {
+public:
+  // Takes over `fd`: it is closed with the reader unless it is stdin.
+  FdReader(int fd, PcmRing &ring);
+  ~FdReader();
+
+  // Bytes written into the fd that haven't been read yet (pipes only).
+  size_t pending() const;
+
+private:
+  void run();
+
+  int fd;
+  PcmRing &ring;
+  std::atomic<bool> stopping{false};
+  std::thread thread;
+};
+
+// Parses "FORMAT:RATE:CHANNELS", FORMAT one of u8, s8, u16, s16, s32, e.g.
+// "s16:44100:2".
+bool parse_pcm_spec(const char *spec, SDL_AudioFormat &format, long &rate,
+                    int &channels);
+
+uint64_t monotonic_ns();
+
+// `audio-visualizer shm-feed NAME FORMAT:RATE:CHANNELS` copies raw PCM from
+// stdin into a new shared-memory ring NAME, which the visualizer reads with
+// `--shm NAME`. Returns the process exit code.
+int shm_feed(int argc, char **argv);
+
+#endif
@@ -0,0 +1,177 @@
+#include "thread_pool.h"
+#include <utility>
+
+static thread_local const ThreadPool *current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+ThreadPool::ThreadPool(size_t num_workers) {
+  if (num_workers == 0) {
+    num_workers = 1;
+  }
+  for (size_t i = 0; i < num_workers; i++) {
+    workers.push_back(std::make_unique<Worker>());
+  }
+  for (size_t i = 0; i < num_workers; i++) {
+    workers[i]->thread = std::thread(&ThreadPool::run, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  wait_idle();
+  {
+    std::lock_guard<std::mutex> guard(sleep_lock);
+    stopping = true;
+  }
+  wake_up.notify_all();
+  for (auto &worker : workers) {
+    worker->thread.join();
+  }
+}
+
+void ThreadPool::submit(Task task, Priority priority) {
+  size_t index = current_pool == this
+                     ? current_worker
+                     : next_worker.fetch_add(1) % workers.size();
+  pending++;
+  {
+    std::lock_guard<std::mutex> guard(workers[index]->lock);
+    workers[index]->tasks[priority].push_back(std::move(task));
+  }
+  std::lock_guard<std::mutex> guard(sleep_lock);
+  wake_up.notify_one();
+}
+
+void ThreadPool::wait_idle() {
+  std::unique_lock<std::mutex> guard(sleep_lock);
+  idle.wait(guard, [this] { return pending == 0; });
+}
+
+bool ThreadPool::pop_local(size_t index, int lane, Task &task) {
+  std::lock_guard<std::mutex> guard(workers[index]->lock);
+  std::deque<Task> &tasks = workers[index]->tasks[lane];
+  if (tasks.empty()) {
+    return false;
+  }
+  task = std::move(tasks.back());
+  tasks.pop_back();
+  return true;
+}
+
+// thief is the stealing worker, or workers.size() for another thread.
+bool ThreadPool::steal(size_t thief, int lane, Task &task) {
+  for (size_t i = 1; i <= workers.size(); i++) {
+    size_t victim_index = (thief + i) % workers.size();
+    if (victim_index == thief) {
+      continue;
+    }
+    Worker &victim = *workers[victim_index];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (!victim.tasks[lane].empty()) {
+      task = std::move(victim.tasks[lane].front());
+      victim.tasks[lane].pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadPool::find_task(size_t index, int lowest, Task &task) {
+  for (int lane = 0; lane <= lowest; lane++) {
+    if ((index < workers.size() && pop_local(index, lane, task)) ||
+        steal(index, lane, task)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::execute(Task &task) {
+  task();
+  if (--pending == 0) {
+    std::lock_guard<std::mutex> guard(sleep_lock);
+    idle.notify_all();
+  }
+}
+
+bool ThreadPool::run_pending(Priority lowest) {
+  size_t index = current_pool == this ? current_worker : workers.size();
+  Task task;
+  if (!find_task(index, lowest, task)) {
+    return false;
+  }
+  execute(task);
+  return true;
+}
+
+void ThreadPool::run(size_t index) {
+  current_pool = this;
+  current_worker = index;
+
+  while (true) {
+    Task task;
+    if (find_task(index, PRIORITY_COUNT - 1, task)) {
+      execute(task);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> guard(sleep_lock);
+    if (stopping) {
+      return;
+    }
+    // Tasks are queued before the notification is sent under sleep_lock, so a
+    // worker that finds nothing here can safely sleep until the next submit.
+    wake_up.wait(guard, [&] {
+      if (stopping) {
+        return true;
+      }
+      for (auto &worker : workers) {
+        std::lock_guard<std::mutex> worker_guard(worker->lock);
+        for (auto &lane : worker->tasks) {
+          if (!lane.empty()) {
+            return true;
+          }
+        }
+      }
+      return false;
+    });
+  }
+}
+
+ThreadPool &shared_pool() {
+  static ThreadPool pool;
+  return pool;
+}
+
+TaskGroup::TaskGroup(ThreadPool &pool, ThreadPool::Priority priority)
+    : pool(pool), priority(priority) {}
+
+TaskGroup::~TaskGroup() { wait(); }
+
+void TaskGroup::run(ThreadPool::Task task) { run(std::move(task), priority); }
+
+void TaskGroup::run(ThreadPool::Task task,
+                    ThreadPool::Priority task_priority) {
+  remaining++;
+  pool.submit(
+      [this, task = std::move(task)] {
+        task();
+        std::lock_guard<std::mutex> guard(lock);
+        if (--remaining == 0) {
+          done.notify_all();
+        }
+      },
+      task_priority);
+}
+
+void TaskGroup::wait() {
+  while (remaining != 0) {
+    if (pool.run_pending(priority)) {
+      continue;
+    }
+    // Everything of ours is running on some worker.
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this] { return remaining == 0; });
+  }
+  // The last task may still be inside its notification.
+  std::lock_guard<std::mutex> guard(lock);
+}
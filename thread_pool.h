@@ -0,0 +1,107 @@
+#ifndef _AUDIO_VISUALIZER_THREAD_POOL_H_
+#define _AUDIO_VISUALIZER_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool: every worker owns a deque, pops its own tasks LIFO and
+// steals the oldest task of another worker when it runs dry. Tasks submitted
+// from inside a worker land on that worker's deque, so recursively split work
+// stays local until somebody idle steals it.
+//
+// Each deque is split into priority lanes. A worker looking for work takes
+// the highest lane that has a task anywhere, its own or stolen, so real-time
+// analysis never waits behind background work that is still queued.
+class ThreadPool {
+public:
+  using Task = std::function<void()>;
+
+  enum Priority {
+    PRIORITY_REALTIME,   // needed for the frame being played
+    PRIORITY_NORMAL,     // needed soon: decoding, batch jobs
+    PRIORITY_BACKGROUND, // cache warming, precomputation
+    PRIORITY_COUNT
+  };
+
+  explicit ThreadPool(size_t num_workers = std::thread::hardware_concurrency());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(Task task, Priority priority = PRIORITY_NORMAL);
+
+  // Blocks until every submitted task (including ones spawned by tasks) ran.
+  void wait_idle();
+
+  // Runs one queued task of at least `lowest` priority on the calling
+  // thread. Returns false when there was none.
+  bool run_pending(Priority lowest);
+
+  size_t size() const { return workers.size(); }
+
+private:
+  struct Worker {
+    std::mutex lock;
+    std::deque<Task> tasks[PRIORITY_COUNT];
+    std::thread thread;
+  };
+
+  void run(size_t index);
+  bool pop_local(size_t index, int lane, Task &task);
+  bool steal(size_t thief, int lane, Task &task);
+  // index is the calling worker, or size() for any other thread.
+  bool find_task(size_t index, int lowest, Task &task);
+  void execute(Task &task);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::atomic<size_t> next_worker{0};
+  std::atomic<size_t> pending{0};
+  std::atomic<bool> stopping{false};
+
+  std::mutex sleep_lock;
+  std::condition_variable wake_up;
+  std::condition_variable idle;
+};
+
+// The pool the visualizer shares between decoding, analysis and drawing,
+// one worker per hardware thread. Created on first use.
+ThreadPool &shared_pool();
+
+// Tasks that can be waited for on their own, without waiting for the rest
+// of the pool. A thread waiting for the group runs queued tasks of the
+// group's priority or higher meanwhile, so waiting from inside a worker
+// can't deadlock and a waiting real-time thread does its share. Those tasks
+// may be anybody's and run with whatever locks the waiting thread holds, so
+// tasks must not take locks that are held while waiting (big_lock).
+class TaskGroup {
+public:
+  explicit TaskGroup(ThreadPool &pool, ThreadPool::Priority priority =
+                                           ThreadPool::PRIORITY_NORMAL);
+  ~TaskGroup();
+
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  void run(ThreadPool::Task task);
+  // With another priority than the group's; wait() only helps with those
+  // when they are at least as urgent.
+  void run(ThreadPool::Task task, ThreadPool::Priority task_priority);
+  void wait();
+
+private:
+  ThreadPool &pool;
+  ThreadPool::Priority priority;
+  std::atomic<size_t> remaining{0};
+  std::mutex lock;
+  std::condition_variable done;
+};
+
+#endif
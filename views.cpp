@@ -0,0 +1,80 @@
+#include "views.h"
+
+static std::vector<RegisteredView> views;
+static unsigned ui_features = 0;
+static unsigned last_ui_features = 0;
+
+void register_view(const ViewPlugin &plugin, bool enabled) {
+  views.push_back(RegisteredView{plugin, enabled, ViewTimer()});
+}
+
+std::vector<RegisteredView> &registered_views() { return views; }
+
+void init_views() {
+  for (RegisteredView &view : views) {
+    if (view.plugin.init != nullptr) {
+      view.plugin.init();
+    }
+  }
+}
+
+unsigned active_features() {
+  // The UI of the frame being built adds to the last complete one.
+  unsigned features = ui_features | last_ui_features;
+  for (const RegisteredView &view : views) {
+    if (view.enabled) {
+      features |= view.plugin.features;
+    }
+  }
+  return features;
+}
+
+void add_ui_features(unsigned features) { ui_features |= features; }
+
+std::vector<std::pair<RegisteredView *, ViewRect>> view_layout(float width,
+                                                               float height) {
+  std::vector<RegisteredView *> enabled;
+  for (RegisteredView &view : views) {
+    if (view.enabled) {
+      enabled.push_back(&view);
+    }
+  }
+  std::vector<ViewRect> rects = tile_views(enabled.size(), width, height);
+  std::vector<std::pair<RegisteredView *, ViewRect>> layout;
+  for (size_t i = 0; i < enabled.size(); i++) {
+    layout.emplace_back(enabled[i], rects[i]);
+  }
+  return layout;
+}
+
+void draw_view_overlays(const AnalysisFrame &frame, float width,
+                        float height) {
+  for (auto &[view, rect] : view_layout(width, height)) {
+    if (view->plugin.overlay != nullptr) {
+      view->plugin.overlay(frame, rect);
+    }
+  }
+}
+
+void draw_views(const AnalysisFrame &frame, float width, float height) {
+  last_ui_features = ui_features;
+  ui_features = 0;
+
+  glEnable(GL_SCISSOR_TEST);
+  for (auto &[view, rect] : view_layout(width, height)) {
+    set_view(rect, height, view->plugin.below);
+    view->timer.begin();
+    view->plugin.display(frame);
+    view->timer.end();
+  }
+  glDisable(GL_SCISSOR_TEST);
+  glViewport(0, 0, width, height);
+}
+
+void views_handle_key() {
+  for (RegisteredView &view : views) {
+    if (view.enabled && view.plugin.handle_key != nullptr) {
+      view.plugin.handle_key();
+    }
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef _AUDIO_VISUALIZER_VIEWS_H_
+#define _AUDIO_VISUALIZER_VIEWS_H_
+
+#include "layout.h"
+#include <cstddef>
+#include <vector>
+
+// What the analysis computes for the views. Only features some enabled view
+// (or the UI, see add_ui_features()) asked for are computed.
+enum Feature : unsigned {
+  FEATURE_SPECTRUM = 1 << 0, // history of the selected source, bins or bands
+  FEATURE_WAVEFORM = 1 << 1, // newest block of samples
+  FEATURE_LOUDNESS = 1 << 2, // loudness and stereo meters
+  FEATURE_BEATS = 1 << 3,
+  FEATURE_PITCH = 1 << 4,
+  FEATURE_PARTIALS = 1 << 5,
+};
+
+// A visualization. Optional callbacks may be null.
+struct ViewPlugin {
+  const char *name;
+  unsigned features; // Feature bits the view needs while it is enabled
+  // Once the GL context exists.
+  void (*init)();
+  // Draws into the view's viewport.
+  void (*display)(const AnalysisFrame &frame);
+  // ImGui foreground drawing over the view, during the ImGui frame.
+  void (*overlay)(const AnalysisFrame &frame, const ViewRect &rect);
+  // A key went down that the UI didn't take, see keyboard_state.
+  void (*handle_key)();
+  // Viewport extension, see set_view().
+  int below;
+};
+
+struct RegisteredView {
+  ViewPlugin plugin;
+  bool enabled;
+  ViewTimer timer;
+};
+
+void register_view(const ViewPlugin &plugin, bool enabled);
+// In registration order, which is also the layout order.
+std::vector<RegisteredView> &registered_views();
+
+void init_views();
+
+// Features of the enabled views and of the UI of the current frame.
+unsigned active_features();
+// The UI shows something needing `features` this frame; cleared by
+// draw_views().
+void add_ui_features(unsigned features);
+
+// Enabled views and where they go in a window of that size.
+std::vector<std::pair<RegisteredView *, ViewRect>> view_layout(float width,
+                                                               float height);
+
+void draw_view_overlays(const AnalysisFrame &frame, float width, float height);
+void draw_views(const AnalysisFrame &frame, float width, float height);
+void views_handle_key();
+
+#endif
@@ -0,0 +1,146 @@
+#include "waterfall.h"
+#include "fft.h"
+#include "frame_arena.h"
+#include "gl.h"
+#include "global.h"
+#include "plot_utils.h"
+#include "shader_utils.h"
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+static const char *VERTEX_SHADER = "waterfall.vertex.glsl";
+static const char *FRAGMENT_SHADER = "waterfall.fragment.glsl";
+
+// Rows kept in the ring texture, one per analysis frame.
+static const int WATERFALL_SECONDS = 120;
+// Magnitudes this far below MAX_FFT_OUTPUT are drawn as silence.
+static const float RANGE_DB = 90;
+// From silence to full scale.
+static const GradientStop GRADIENT_STOPS[] = {{0.0, {0.0, 0.0, 0.0}},
+                                              {0.3, {0.1, 0.0, 0.4}},
+                                              {0.55, {0.7, 0.1, 0.4}},
+                                              {0.8, {1.0, 0.6, 0.0}},
+                                              {1.0, {1.0, 1.0, 0.8}}};
+
+static GLuint program;
+static GLint attribute_corner;
+static GLint uniform_history;
+static GLint uniform_gradient;
+static GLint uniform_head;
+static GLint uniform_rows;
+static GLint uniform_scale;
+static GLint uniform_range_db;
+static GLuint quad_vbo;
+static GLuint gradient;
+
+// Raw magnitudes, row `head` is the newest. Nothing is ever moved: a new
+// analysis frame overwrites the oldest row and becomes the head.
+static GLuint history_texture;
+static size_t texture_bins = 0;
+static size_t texture_rows = 0;
+static size_t head = 0;
+// One past the newest frame in the ring.
+static uint64_t uploaded_end = 0;
+// Catching up with a long gap would otherwise hold big_lock, and with it
+// the audio callback, for the whole ring.
+static const size_t MAX_ROWS_PER_DISPLAY = 256;
+
+void waterfallInit() {
+  program = create_program(VERTEX_SHADER, FRAGMENT_SHADER);
+  if (program == 0) {
+    throw std::runtime_error("couldn't create waterfall program");
+  }
+  attribute_corner = get_attrib(program, "corner");
+  uniform_history = get_uniform(program, "history");
+  uniform_gradient = get_uniform(program, "gradient");
+  uniform_head = get_uniform(program, "head");
+  uniform_rows = get_uniform(program, "rows");
+  uniform_scale = get_uniform(program, "scale");
+  uniform_range_db = get_uniform(program, "range_db");
+
+  const GLfloat quad[] = {-1, -1, 1, -1, -1, 1, 1, 1};
+  glGenBuffers(1, &quad_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+
+  gradient = gradient_texture(GRADIENT_STOPS, std::size(GRADIENT_STOPS));
+
+  glGenTextures(1, &history_texture);
+}
+
+// (Re)allocates the ring for `bins` and clears it.
+static void reset_history(size_t bins) {
+  GLint max_size;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+  texture_bins = bins;
+  texture_rows = std::min<size_t>(WATERFALL_SECONDS * TARGET_FPS, max_size);
+  head = 0;
+
+  glBindTexture(GL_TEXTURE_2D, history_texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  std::vector<float> zeros(texture_bins * texture_rows, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, texture_bins, texture_rows, 0,
+               GL_RED, GL_FLOAT, zeros.data());
+}
+
+// Writes `values` as the new head row.
+static void push_row(const double *values, float *row) {
+  std::copy(values, values + texture_bins, row);
+  head = (head + 1) % texture_rows;
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, head, texture_bins, 1, GL_RED,
+                  GL_FLOAT, row);
+}
+
+void waterfallDisplay(
+    size_t bins, uint64_t end,
+    const std::function<bool(uint64_t, double *)> &read_frame) {
+  if (bins == 0) {
+    big_lock.unlock();
+    return;
+  }
+
+  glActiveTexture(GL_TEXTURE0);
+  if (bins != texture_bins || end < uploaded_end) {
+    reset_history(bins);
+    uploaded_end = 0;
+  }
+  glBindTexture(GL_TEXTURE_2D, history_texture);
+  uint64_t first =
+      std::max(uploaded_end, end - std::min<uint64_t>(end, texture_rows));
+  uint64_t last = std::min<uint64_t>(end, first + MAX_ROWS_PER_DISPLAY);
+  double *values = frame_arena.alloc<double>(texture_bins);
+  float *row = frame_arena.alloc<float>(texture_bins);
+  for (uint64_t frame = first; frame < last; frame++) {
+    if (!read_frame(frame, values)) {
+      std::fill(values, values + texture_bins, 0);
+    }
+    push_row(values, row);
+  }
+  uploaded_end = last;
+  big_lock.unlock();
+
+  glUseProgram(program);
+  glUniform1i(uniform_history, 0);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, gradient);
+  glUniform1i(uniform_gradient, 1);
+  glActiveTexture(GL_TEXTURE0);
+  glUniform1f(uniform_head, head);
+  glUniform1f(uniform_rows, texture_rows);
+  glUniform1f(uniform_scale, 1.0 / MAX_FFT_OUTPUT);
+  glUniform1f(uniform_range_db, RANGE_DB);
+
+  glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+  glEnableVertexAttribArray(attribute_corner);
+  glVertexAttribPointer(attribute_corner, 2, GL_FLOAT, GL_FALSE, 0, 0);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  glDisableVertexAttribArray(attribute_corner);
+}
+
+void waterfallReset() { texture_bins = 0; }
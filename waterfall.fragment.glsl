@@ -0,0 +1,16 @@
+uniform sampler2D history;  // ring of spectra, one row per analysis frame
+uniform sampler2D gradient; // colors from silence to full scale
+uniform float head;         // ring row of the newest spectrum
+uniform float rows;
+uniform float scale;        // magnitude of full scale, inverted
+uniform float range_db;     // shown below full scale
+varying vec2 position;
+
+void main(void) {
+	// The texture repeats vertically, rows older than the head wrap around.
+	float v = (head + 0.5 - position.y * rows) / rows;
+	float magnitude = texture2D(history, vec2(position.x, v)).r * scale;
+	float db = 20.0 * log(max(magnitude, 1e-10)) / log(10.0);
+	float level = clamp(1.0 + db / range_db, 0.0, 1.0);
+	gl_FragColor = texture2D(gradient, vec2(level, 0.5));
+}
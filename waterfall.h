@@ -0,0 +1,27 @@
+#ifndef _AUDIO_VISUALIZER_WATERFALL_H_
+#define _AUDIO_VISUALIZER_WATERFALL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+void waterfallInit();
+
+// The spectrum as a scrolling image, newest row at the top, bins from left
+// to right. Rows are numbered like the scrollback's frames and the image
+// keeps WATERFALL_SECONDS of them: each one goes into a ring texture once,
+// and scrolling only moves the ring's head in the fragment shader.
+//
+// Frames before `end` that aren't in the ring yet, including ones that
+// arrived while nothing was drawn, are fetched oldest first with
+// `read_frame`, which writes `bins` values and returns false for a frame
+// that isn't kept anymore. A long gap is caught up over a few calls. Call
+// with big_lock held, it is released once the new rows are uploaded.
+void waterfallDisplay(
+    size_t bins, uint64_t end,
+    const std::function<bool(uint64_t, double *)> &read_frame);
+// Refetches every row on the next display, for frames that now read
+// differently (another data source).
+void waterfallReset();
+
+#endif
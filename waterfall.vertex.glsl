@@ -0,0 +1,7 @@
+attribute vec2 corner;
+varying vec2 position; // x across the bins, y from the newest row (0) down
+
+void main(void) {
+	position = vec2(0.5 * (corner.x + 1.0), 0.5 * (1.0 - corner.y));
+	gl_Position = vec4(corner, 0, 1);
+}
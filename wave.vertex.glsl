@@ -1,7 +1,11 @@
-attribute vec2 coord2d;
+attribute float index;  // of the sample in the block
+attribute float sample; // in the units of the audio format
+uniform float last;     // index of the last sample
+uniform float scale;    // sample * scale + offset is -1 ... 1
+uniform float offset;
 varying vec4 f_color;
 
 void main(void) {
-	gl_Position = vec4(coord2d.x, coord2d.y, 0, 1);
+	gl_Position = vec4(2.0 * index / last - 1.0, 0.9 * (sample * scale + offset), 0, 1);
     f_color = vec4(1.0, 1.0, 1.0, 1.0);
 }